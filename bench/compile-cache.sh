@@ -0,0 +1,33 @@
+#!/bin/sh
+# Compile time of the rule sets of bench/corpus.sh with --compile-cache: once
+# on an empty cache, then again with every action changed, which should hit
+# and leave only code generation to run.
+#   usage: bench/compile-cache.sh [path/to/ft_lex]
+#   environment:
+#     BENCH_SETS  rule sets, as named by bench/corpus.sh (default all)
+
+FT_LEX=${1:-./ft_lex}
+SETS=${BENCH_SETS:-c-tokens keywords-1000 keywords-50000 classes-2000 nested-64}
+CORPUS=$(dirname "$0")/corpus.sh
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+now_ms() {
+	echo $(($(date +%s%N) / 1000000))
+}
+
+# compiles $1 with the cache, prints the milliseconds and whether it hit
+compile() {
+	start=$(now_ms)
+	"$FT_LEX" --compile-cache="$WORK/cache" --stats -o "$WORK/$2" "$WORK/$1" 2> "$WORK/stats" || { cat "$WORK/stats" >&2; return 1; }
+	echo "$(($(now_ms) - start)) $(sed -n 's/^Compile cache: //p' "$WORK/stats")"
+}
+
+printf '%-16s %10s %6s %10s %6s\n' set cold-ms cache warm-ms cache
+for set in $SETS; do
+	sh "$CORPUS" "$WORK" 1 "$set" || exit 1
+	cold=$(compile "$set.l" cold.c) || continue
+	sed 's/return \([0-9]*\);/{ ++count; return \1; }/' "$WORK/$set.l" > "$WORK/$set.actions.l"
+	warm=$(compile "$set.actions.l" warm.c) || continue
+	printf '%-16s %10s %6s %10s %6s\n' "$set" $cold $warm
+done
@@ -0,0 +1,233 @@
+#!/bin/sh
+# Writes the benchmark corpus: for each rule set, <set>.l and an input
+# <set>.in of about the given size that its rules tokenize. Everything comes
+# from a fixed-seed generator, so the same arguments always give the same
+# files. Every .l file is also accepted by flex.
+#   usage: bench/corpus.sh <directory> [MB of input per set] [set...]
+#   sets:  c-tokens keywords-1000 keywords-50000 classes-2000 nested-64
+
+DIR=${1:?usage: bench/corpus.sh <directory> [MB] [set...]}
+MB=${2:-32}
+shift
+[ $# -gt 0 ] && shift
+SETS=${*:-c-tokens keywords-1000 keywords-50000 classes-2000 nested-64}
+mkdir -p "$DIR" || exit 1
+
+# the limits of the legacy % directives, raised out of the way
+LIMITS='%n 10000000
+%p 10000000
+%a 100000000
+%o 100000000
+%e 100000000
+%k 100000000'
+
+# yylex() until the end of the input, then the token count and seconds;
+# ft_lex has a default yywrap(), flex wants one without -lfl
+DRIVER='%%
+#include <time.h>
+
+#ifdef FLEX_SCANNER
+int yywrap(void)
+{
+	return 1;
+}
+#endif
+
+int main(int argc, char **argv)
+{
+	struct timespec t0, t1;
+	long tokens = 0;
+
+	if (argc < 2 || !(yyin = fopen(argv[1], "r"))) {
+		fprintf(stderr, "usage: %s <input>\n", argv[0]);
+		return 1;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	while (yylex())
+		++tokens;
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	printf("%ld %.6f\n", tokens, (double)(t1.tv_sec - t0.tv_sec) + (double)(t1.tv_nsec - t0.tv_nsec) / 1e9);
+	return 0;
+}'
+
+# The generator shared by the awk programs: a 32-bit LCG, exact in the
+# doubles of every awk, and helpers on top of it.
+LCG='
+function rand32() { seed = (seed * 69069 + 1) % 4294967296; return seed }
+function pick(n) { return int(rand32() / 65536) % n }
+function word(alphabet, lo, hi,    w, len, j) {
+	len = lo + pick(hi - lo + 1)
+	w = ""
+	for (j = 0; j < len; ++j)
+		w = w substr(alphabet, 1 + pick(length(alphabet)), 1)
+	return w
+}'
+
+# n distinct upper-case words of 3 to 10 letters
+keywords() {
+	awk -v n="$1" "$LCG"'
+	BEGIN {
+		seed = 7
+		while (count < n) {
+			w = word("ABCDEFGHIJKLMNOPQRSTUVWXYZ", 3, 10)
+			if (!(w in seen)) {
+				seen[w] = 1
+				print w
+				++count
+			}
+		}
+	}'
+}
+
+# $1.in grows to $MB MB by repeating a 1 MB block made by the awk program $2,
+# which reads the rule file's words, if any, on its standard input
+input() {
+	awk -v size=1048576 "$LCG$2" < "${3:-/dev/null}" > "$DIR/$1.block"
+	target=$((MB * 1048576))
+	: > "$DIR/$1.in"
+	while [ "$(wc -c < "$DIR/$1.in")" -lt "$target" ]; do
+		cat "$DIR/$1.block" >> "$DIR/$1.in"
+	done
+	rm -f "$DIR/$1.block"
+}
+
+c_tokens() {
+	{
+		printf '%s\n' "$LIMITS"
+		echo "%%"
+		printf '%s\n' '"if"|"else"|"while"|"for"|"return"|"int"|"char"|"void"	return 1;'
+		printf '%s\n' '[A-Za-z_][A-Za-z0-9_]*	return 2;'
+		printf '%s\n' '[0-9]+	return 3;'
+		printf '%s\n' '\"([^"\\\n]|\\.)*\"	return 4;'
+		printf '%s\n' '"/*"([^*]|"*"+[^*/])*"*"+"/"	return 5;'
+		printf '%s\n' '[-+*/=<>!&|;,(){}]	return 6;'
+		printf '%s\n' '[\x20\t\n\r]+	;'
+		printf '%s\n' '.	return 7;'
+		printf '%s\n' "$DRIVER"
+	} > "$DIR/c-tokens.l"
+	input c-tokens '
+	BEGIN {
+		seed = 1
+		split("if else while for return int char void", kw, " ")
+		split("+ - * / = < > ! & | ; , ( ) { }", op, " ")
+		while (bytes < size) {
+			k = pick(10)
+			if (k < 2) t = kw[1 + pick(8)]
+			else if (k < 5) t = word("abcdefghijklmnopqrstuvwxyz", 1, 1) word("abcdefghijklmnopqrstuvwxyz_0123456789", 0, 11)
+			else if (k < 6) t = word("0123456789", 1, 6)
+			else if (k < 7) t = "\"" word("abc def", 0, 20) "\""
+			else if (k < 8 && pick(4) == 0) t = "/* " word("abc *def", 0, 30) " */"
+			else t = op[1 + pick(17)]
+			t = t (pick(8) ? " " : "\n")
+			printf "%s", t
+			bytes += length(t)
+		}
+	}'
+}
+
+# a keyword rule per word, each also an identifier
+keywords_set() {
+	name=keywords-$1
+	keywords "$1" > "$DIR/$name.words"
+	{
+		printf '%s\n' "$LIMITS"
+		echo "%%"
+		awk '{ printf "\"%s\"\treturn 1;\n", $0 }' "$DIR/$name.words"
+		printf '%s\n' '[A-Za-z_][A-Za-z0-9_]*	return 2;'
+		printf '%s\n' '[0-9]+	return 3;'
+		printf '%s\n' '[\x20\t\n]+	;'
+		printf '%s\n' '.	return 4;'
+		printf '%s\n' "$DRIVER"
+	} > "$DIR/$name.l"
+	input "$name" '
+	{ kw[++n] = $0 }
+	END {
+		seed = 2
+		while (bytes < size) {
+			k = pick(10)
+			if (k < 5) t = kw[1 + pick(n)]
+			else if (k < 9) t = word("ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz", 2, 12)
+			else t = word("0123456789", 1, 8)
+			t = t (pick(10) ? " " : "\n")
+			printf "%s", t
+			bytes += length(t)
+		}
+	}' "$DIR/$name.words"
+	rm -f "$DIR/$name.words"
+}
+
+# rules of a distinct literal prefix, then random character classes over
+# lower-case letters and digits, with a catch-all word rule behind them; the
+# prefixes keep the DFA linear while the classes split the bytes finely
+classes_set() {
+	name=classes-$1
+	{
+		printf '%s\n' "$LIMITS"
+		echo "%%"
+		awk -v n="$1" "$LCG"'
+		function class(    a, b, c, d) {
+			a = 1 + pick(36); b = a + pick(37 - a)
+			c = 1 + pick(36); d = c + pick(37 - c)
+			return "[" substr(set, a, 1) "-" substr(set, b, 1) substr(set, c, 1) "-" substr(set, d, 1) "]"
+		}
+		BEGIN {
+			seed = 3
+			set = "0123456789abcdefghijklmnopqrstuvwxyz"
+			for (r = 1; r <= n; ++r)
+				printf "\"k%04d\"%s%s*\treturn %d;\n", r, class(), class(), r
+		}'
+		echo "[a-z0-9]+	return $(($1 + 1));"
+		printf '%s\n' '[\x20\t\n]+	;'
+		echo ".	return $(($1 + 2));"
+		printf '%s\n' "$DRIVER"
+	} > "$DIR/$name.l"
+	input "$name" '
+	BEGIN {
+		seed = 4
+		while (bytes < size) {
+			t = pick(2) ? sprintf("k%04d", 1 + pick('"$1"')) : ""
+			t = t word("abcdefghijklmnopqrstuvwxyz0123456789", 2, 14) (pick(10) ? " " : "\n")
+			printf "%s", t
+			bytes += length(t)
+		}
+	}'
+}
+
+# a chain of definitions, each one made of the one before
+nested_set() {
+	name=nested-$1
+	{
+		printf '%s\n' "$LIMITS"
+		echo "D0	[a-z]"
+		i=1
+		while [ "$i" -le "$1" ]; do
+			echo "D$i	{D$((i - 1))}[a-z0-9]?"
+			i=$((i + 1))
+		done
+		echo "%%"
+		echo "{D$1}	return 1;"
+		echo "[0-9]+	return 2;"
+		printf '%s\n' '[\x20\t\n]+	;'
+		echo ".	return 3;"
+		printf '%s\n' "$DRIVER"
+	} > "$DIR/$name.l"
+	input "$name" '
+	BEGIN {
+		seed = 5
+		while (bytes < size) {
+			t = word("abcdefghijklmnopqrstuvwxyz0123456789", 1, 16) (pick(10) ? " " : "\n")
+			printf "%s", t
+			bytes += length(t)
+		}
+	}'
+}
+
+for set in $SETS; do
+	case $set in
+		c-tokens) c_tokens ;;
+		keywords-*) keywords_set "${set#keywords-}" ;;
+		classes-*) classes_set "${set#classes-}" ;;
+		nested-*) nested_set "${set#nested-}" ;;
+		*) echo "unknown set: $set" >&2; exit 1 ;;
+	esac
+done
@@ -0,0 +1,94 @@
+#!/bin/sh
+# Automaton sizes of keyword-heavy rule sets, with the keywords looked up in
+# the identifier rule's lexemes and with them compiled into the DFA
+# (--no-keywords), then the scanning speed of the keywords-<n> sets of
+# bench/corpus.sh as n grows. A lookup is one hash and at most one memcmp()
+# whatever the keyword count, so MB/s should stay flat from 1k to 50k.
+#   usage: bench/keywords.sh [path/to/ft_lex]
+#   environment:
+#     BENCH_MB    MB of input per set (default 16)
+#     CC          compiler to use
+
+FT_LEX=${1:-./ft_lex}
+MB=${BENCH_MB:-16}
+CC=${CC:-cc}
+CORPUS=$(dirname "$0")/corpus.sh
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+SQL="ADD ALL ALTER AND ANY AS ASC BACKUP BETWEEN BY CASE CHECK COLUMN CONSTRAINT
+CREATE DATABASE DEFAULT DELETE DESC DISTINCT DROP EXEC EXISTS FOREIGN FROM FULL
+GROUP HAVING IN INDEX INNER INSERT INTO IS JOIN KEY LEFT LIKE LIMIT NOT NULL OR
+ORDER OUTER PRIMARY PROCEDURE RIGHT ROWNUM SELECT SET TABLE TOP TRUNCATE UNION
+UNIQUE UPDATE VALUES VIEW WHERE BEGIN COMMIT ROLLBACK GRANT REVOKE TRIGGER CURSOR
+FETCH DECLARE RETURN RETURNS FUNCTION WHILE LOOP IF ELSE THEN END CAST CONVERT"
+
+# n pseudo-random upper-case words of 3 to 10 letters, the same on every run
+words() {
+	awk -v n="$1" 'BEGIN {
+		x = 12345
+		for (i = 0; i < n; ++i) {
+			w = ""
+			x = (x * 1103515245 + 12345) % 2147483648
+			len = 3 + x % 8
+			for (j = 0; j < len; ++j) {
+				x = (x * 1103515245 + 12345) % 2147483648
+				w = w substr("ABCDEFGHIJKLMNOPQRSTUVWXYZ", 1 + int(x / 65536) % 26, 1)
+			}
+			print w
+		}
+	}' | sort -u
+}
+
+# minimized DFA states and compressed table bytes of $WORK/kw.l
+sizes() {
+	"$FT_LEX" --stats "$@" -o "$WORK/lex.yy.c" "$WORK/kw.l" 2> "$WORK/stats" || return 1
+	echo "$(sed -n 's/^Minimized DFA states: //p' "$WORK/stats")" \
+		"$(sed -n 's/^Compressed tables: \([0-9]*\).*/\1/p' "$WORK/stats")"
+}
+
+# prints one row: rule set, keyword count, then DFA states and compressed
+# table bytes with and without the lookup
+run() {
+	{
+		echo "%n 10000000"
+		echo "%p 10000000"
+		echo "%a 100000000"
+		echo "%o 100000000"
+		echo "%%"
+		for w in $2; do
+			echo "\"$w\"	return 1;"
+		done
+		echo "[A-Za-z_][A-Za-z0-9_]*	return 2;"
+		echo "[0-9]+	return 3;"
+		printf '%s\n' '[\t\n]+	;'
+		echo ".	return 4;"
+		echo "%%"
+	} > "$WORK/kw.l"
+	count=$(echo $2 | wc -w)
+	lookup=$(sizes) || { echo "$1: failed"; cat "$WORK/stats"; return; }
+	inline=$(sizes --no-keywords) || { echo "$1: failed"; cat "$WORK/stats"; return; }
+	printf '%-12s %9s %10s %12s %10s %12s\n' "$1" "$count" $lookup $inline
+}
+
+printf '%-12s %9s %10s %12s %10s %12s\n' rules keywords dfa tables dfa-inline tables-inline
+run sql "$SQL"
+for n in 250 1000; do
+	run "random-$n" "$(words $n)"
+done
+
+# prints one row: keyword count, tokens, seconds and MB/s of keywords-$1
+speed() {
+	sh "$CORPUS" "$WORK" "$MB" "keywords-$1" || return 1
+	"$FT_LEX" -o "$WORK/lex.yy.c" "$WORK/keywords-$1.l" || return 1
+	$CC -O2 -o "$WORK/scanner" "$WORK/lex.yy.c" || return 1
+	result=$("$WORK/scanner" "$WORK/keywords-$1.in") || return 1
+	echo "$1 $(wc -c < "$WORK/keywords-$1.in") $result" | awk '{ printf "%-16s %9s %10s %12s %10.1f\n", "keywords-" $1, $1, $3, $4, $2 / $4 / 1e6 }'
+	rm -f "$WORK/keywords-$1.l" "$WORK/keywords-$1.in"
+}
+
+echo
+printf '%-16s %9s %10s %12s %10s\n' set keywords tokens seconds MB/s
+for n in 1000 5000 20000 50000; do
+	speed "$n" || echo "keywords-$n: failed"
+done
@@ -0,0 +1,39 @@
+#!/bin/sh
+# Time of the lex file stage as the rule section grows, in rule count and in
+# the length of one action. Doubling the size should about double the time,
+# so the last column, milliseconds per thousand rules or lines, should stay
+# flat.
+#   usage: bench/parsing.sh [path/to/ft_lex]
+
+FT_LEX=${1:-./ft_lex}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+# prints one row: what grows, its size, the lex file milliseconds and their
+# share per thousand
+run() {
+	"$FT_LEX" --stats -o "$WORK/lex.yy.c" "$WORK/parse.l" 2> "$WORK/stats" || { echo "$1 $2: failed"; cat "$WORK/stats"; return; }
+	ms=$(sed -n 's/^  lex file: \([0-9.]*\) ms.*/\1/p' "$WORK/stats")
+	printf '%-8s %10s %10s %10s\n' "$1" "$2" "$ms" "$(echo "$ms $2" | awk '{ printf "%.3f", $1 / $2 * 1000 }')"
+}
+
+printf '%-8s %10s %10s %10s\n' grows size lex-ms ms/1000
+for n in 25000 50000 100000; do
+	{
+		printf '%s\n' "%n 10000000" "%p 10000000" "%a 100000000" "%o 100000000" "%e 100000000"
+		echo "%s A B"
+		echo "%%"
+		awk -v n="$n" 'BEGIN { for (i = 0; i < n; ++i) printf "<A,B>\"k%d\"[ ]\t{ return %d; }\n", i % 10, i }'
+	} > "$WORK/parse.l"
+	run rules "$n"
+done
+for n in 2500 5000 10000; do
+	{
+		echo "%%"
+		echo "x	{"
+		awk -v n="$n" 'BEGIN { for (i = 0; i < n; ++i) printf "\tif (yyleng > %d) { puts(\"}\"); } /* { */\n", i }'
+		echo "	return 1;"
+		echo "}"
+	} > "$WORK/parse.l"
+	run lines "$n"
+done
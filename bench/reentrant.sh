@@ -0,0 +1,94 @@
+#!/bin/sh
+# Aggregate throughput of reentrant scanners, one per thread, each scanning
+# its own copy of the same C-like input, from 1 thread up to one per core.
+# The scanners share nothing but the read-only tables, so the MB/s should
+# grow linearly with the threads until the cores run out.
+#   usage: bench/reentrant.sh [path/to/ft_lex] [MB per thread]
+
+FT_LEX=${1:-./ft_lex}
+MB=${2:-64}
+CC=${CC:-cc}
+CORES=$(nproc 2>/dev/null || echo 1)
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+cat > "$WORK/scan.l" << 'EOF'
+%option reentrant
+%%
+"if"|"else"|"while"|"for"|"return"|"int"|"char"|"void"	return 1;
+[A-Za-z_][A-Za-z0-9_]*	return 2;
+[0-9]+	return 3;
+\"([^"\\\n]|\\.)*\"	return 4;
+"/*"([^*]|"*"+[^*/])*"*"+"/"	return 5;
+[-+*/=<>!&|;,(){}]	return 6;
+[\x20\t\n\r]+	;
+.	return 7;
+%%
+#include <pthread.h>
+#include <time.h>
+
+static char *input;
+static size_t input_len;
+
+static void *worker(void *arg)
+{
+	yyscan_t scanner;
+	long tokens = 0;
+
+	if (yylex_init(&scanner) != 0 || yy_scan_bytes(input, input_len, scanner) != 0) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	while (yylex(scanner))
+		++tokens;
+	yylex_destroy(scanner);
+	*(long *)arg = tokens;
+	return NULL;
+}
+
+/* usage: scan <MB per thread> <threads>; prints threads, tokens, MB/s */
+int main(int argc, char **argv)
+{
+	static const char *line = "int main(void) { /* count */ for (i = 0; i < 1024; ++i) total += f(\"text\", i); return 0; }\n";
+	size_t size = (size_t)atol(argv[1]) << 20;
+	int threads = atoi(argv[2]);
+	pthread_t *ids = malloc((size_t)threads * sizeof(*ids));
+	long *tokens = calloc((size_t)threads, sizeof(*tokens));
+	size_t n = strlen(line);
+	struct timespec t0, t1;
+	double seconds;
+	long total = 0;
+	int i;
+
+	(void)argc;
+	input = malloc(size + n);
+	for (input_len = 0; input_len < size; input_len += n)
+		memcpy(input + input_len, line, n);
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (i = 0; i < threads; ++i)
+		pthread_create(&ids[i], NULL, worker, &tokens[i]);
+	for (i = 0; i < threads; ++i)
+		pthread_join(ids[i], NULL);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	seconds = (double)(t1.tv_sec - t0.tv_sec) + (double)(t1.tv_nsec - t0.tv_nsec) / 1e9;
+	for (i = 0; i < threads; ++i)
+		total += tokens[i];
+	printf("%d %ld %.1f\n", threads, total, (double)input_len * threads / seconds / 1e6);
+	return 0;
+}
+EOF
+
+"$FT_LEX" -o "$WORK/lex.yy.c" "$WORK/scan.l" || exit 1
+$CC -O2 -pthread -o "$WORK/scan" "$WORK/lex.yy.c" || exit 1
+
+printf '%8s %12s %10s %8s\n' threads tokens MB/s speedup
+base=
+t=1
+while :; do
+	set -- $("$WORK/scan" "$MB" "$t")
+	base=${base:-$3}
+	printf '%8s %12s %10s %8s\n' "$1" "$2" "$3" "$(echo "$3 $base" | awk '{ printf "%.2f", $1 / $2 }')"
+	[ "$t" -ge "$CORES" ] && break
+	t=$((t * 2))
+	[ "$t" -gt "$CORES" ] && t=$CORES
+done
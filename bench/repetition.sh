@@ -0,0 +1,42 @@
+#!/bin/sh
+# Compile time and automaton sizes of counted repetitions as their bounds
+# grow. Every row should grow roughly linearly with the count.
+#   usage: bench/repetition.sh [path/to/ft_lex]
+
+FT_LEX=${1:-./ft_lex}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+# prints one row: pattern, NFA states, DFA states before and after
+# minimization, table bytes and the wall time of the whole compile
+run() {
+	{
+		echo "%n 10000000"
+		echo "%p 10000000"
+		echo "%a 100000000"
+		echo "%o 100000000"
+		echo "X	[a-z]"
+		echo "%%"
+		echo "$1	;"
+		echo "%%"
+	} > "$WORK/rep.l"
+	start=$(date +%s%N)
+	"$FT_LEX" --stats -o "$WORK/lex.yy.c" "$WORK/rep.l" 2> "$WORK/stats" || { echo "$1: failed"; cat "$WORK/stats"; return; }
+	end=$(date +%s%N)
+	nfa=$(sed -n 's/^NFA states: //p' "$WORK/stats")
+	dfa=$(sed -n 's/^DFA states: //p' "$WORK/stats")
+	min=$(sed -n 's/^Minimized DFA states: //p' "$WORK/stats")
+	tables=$(sed -n 's/^Compressed tables: \([0-9]*\).*/\1/p' "$WORK/stats")
+	printf '%-28s %10s %10s %10s %12s %10s\n' "$1" "$nfa" "$dfa" "$min" "$tables" "$(( (end - start) / 1000000 ))ms"
+}
+
+printf '%-28s %10s %10s %10s %12s %10s\n' pattern nfa dfa minimized tables time
+for n in 100 1000 10000; do
+	run "[0-9]{1,$n}"
+	run "\"jkl\"{$n}"
+	run "[a-z]{$n,}"
+	run "(ab|c){0,$n}d"
+done
+for n in 10 30 100; do
+	run "({X}{2,$n}){2,$n}"
+done
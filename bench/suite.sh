@@ -0,0 +1,102 @@
+#!/bin/sh
+# The benchmark suite behind `make bench`: writes the corpus of
+# bench/corpus.sh, compiles every rule set with ft_lex, and with flex when
+# one is installed, then times each generated scanner on the input of its
+# set. Every run appends one CSV row per set and generator to $BENCH_OUT,
+# with the date and commit, so that results can be tracked across revisions.
+#   usage: bench/suite.sh [path/to/ft_lex]
+#   environment:
+#     BENCH_MB    MB of input per set (default 64; 4096 for GB-scale inputs)
+#     BENCH_SETS  rule sets, as named by bench/corpus.sh (default all)
+#     BENCH_DIR   keep the corpus there and reuse it on later runs
+#     BENCH_OUT   results file (default bench-results.csv)
+#     CC, FLEX    compiler and flex to use
+
+FT_LEX=${1:-./ft_lex}
+MB=${BENCH_MB:-64}
+SETS=${BENCH_SETS:-c-tokens keywords-1000 keywords-50000 classes-2000 nested-64}
+OUT=${BENCH_OUT:-bench-results.csv}
+CC=${CC:-cc}
+FLEX=${FLEX:-flex}
+CORPUS=$(dirname "$0")/corpus.sh
+if [ -n "$BENCH_DIR" ]; then
+	WORK=$BENCH_DIR
+	mkdir -p "$WORK" || exit 1
+else
+	WORK=$(mktemp -d)
+	trap 'rm -rf "$WORK"' EXIT
+fi
+DATE=$(date -u +%Y-%m-%dT%H:%M:%SZ)
+COMMIT=$(git rev-parse --short HEAD 2>/dev/null || echo unknown)
+HAVE_FLEX=$(command -v "$FLEX" > /dev/null 2>&1 && echo 1)
+# peak RSS of other programs needs GNU time
+HAVE_TIME=$(/usr/bin/time -f %M true > /dev/null 2>&1 && echo 1)
+
+if [ ! -s "$OUT" ]; then
+	echo "date,commit,set,generator,rules,compile_ms,lex_ms,regex_ms,nfa_ms,dfa_ms,minimize_ms,codegen_ms,peak_rss_kib,dfa_states,scanner_bytes,input_bytes,tokens,scan_s,mb_s,tokens_s" > "$OUT"
+fi
+
+now_ms() {
+	echo $(($(date +%s%N) / 1000000))
+}
+
+# the value of a --stats line, by its label
+stat() {
+	sed -n "s/^$1: *\([0-9.]*\).*/\1/p" "$WORK/stats"
+}
+
+# the milliseconds of one stage under "Stages:"
+stage() {
+	sed -n "s/^  $1: \([0-9.]*\) ms.*/\1/p" "$WORK/stats"
+}
+
+# compiles lex.yy.c, scans $set.in and prints the scanner columns of a row:
+# scanner bytes, input bytes, tokens, seconds, MB/s and tokens/s
+scan() {
+	$CC -O2 -o "$WORK/scanner" "$WORK/lex.yy.c" || return 1
+	bytes=$(wc -c < "$WORK/$set.in")
+	result=$("$WORK/scanner" "$WORK/$set.in") || return 1
+	set -- $result
+	echo "$(wc -c < "$WORK/lex.yy.c") $bytes $1 $2" | awk '{ printf "%s,%s,%s,%s,%.1f,%.0f", $1, $2, $3, $4, $2 / $4 / 1e6, $3 / $4 }'
+}
+
+printf '%-16s %-8s %7s %10s %10s %10s %10s %12s\n' set tool rules compile-ms rss-kib states MB/s tokens/s
+for set in $SETS; do
+	if [ ! -s "$WORK/$set.l" ] || [ ! -s "$WORK/$set.in" ]; then
+		sh "$CORPUS" "$WORK" "$MB" "$set" || exit 1
+	fi
+	rules=$(awk '/^%%$/ { ++part; next } part == 1 && NF { ++n } END { print n + 0 }' "$WORK/$set.l")
+
+	start=$(now_ms)
+	if ! "$FT_LEX" --stats -o "$WORK/lex.yy.c" "$WORK/$set.l" 2> "$WORK/stats"; then
+		echo "$set: ft_lex failed" >&2
+		cat "$WORK/stats" >&2
+		continue
+	fi
+	compile=$(($(now_ms) - start))
+	row=$(scan) || { echo "$set: the ft_lex scanner failed" >&2; continue; }
+	rss=$(stat "Peak RSS")
+	states=$(stat "Minimized DFA states")
+	echo "$DATE,$COMMIT,$set,ft_lex,$rules,$compile,$(stage "lex file"),$(stage regex),$(stage NFA),$(stage DFA),$(stage minimization),$(stage "code generation"),$rss,$states,$row" >> "$OUT"
+	echo "$row" | awk -F, -v s="$set" -v r="$rules" -v c="$compile" -v m="$rss" -v d="$states" \
+		'{ printf "%-16s %-8s %7s %10s %10s %10s %10s %12s\n", s, "ft_lex", r, c, m, d, $5, $6 }'
+	tokens=$(echo "$row" | cut -d, -f3)
+
+	[ -n "$HAVE_FLEX" ] || continue
+	start=$(now_ms)
+	if [ -n "$HAVE_TIME" ]; then
+		/usr/bin/time -f %M -o "$WORK/rss" "$FLEX" -o "$WORK/lex.yy.c" "$WORK/$set.l" 2> /dev/null
+	else
+		"$FLEX" -o "$WORK/lex.yy.c" "$WORK/$set.l" 2> /dev/null
+	fi || { echo "$set: flex failed" >&2; continue; }
+	compile=$(($(now_ms) - start))
+	rss=$([ -n "$HAVE_TIME" ] && cat "$WORK/rss")
+	row=$(scan) || { echo "$set: the flex scanner failed" >&2; continue; }
+	echo "$DATE,$COMMIT,$set,flex,$rules,$compile,,,,,,,$rss,,$row" >> "$OUT"
+	echo "$row" | awk -F, -v s="$set" -v r="$rules" -v c="$compile" -v m="$rss" \
+		'{ printf "%-16s %-8s %7s %10s %10s %10s %10s %12s\n", s, "flex", r, c, m, "", $5, $6 }'
+	if [ "$(echo "$row" | cut -d, -f3)" != "$tokens" ]; then
+		echo "$set: flex and ft_lex scanners disagree on the token count" >&2
+	fi
+done
+echo "results appended to $OUT"
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "Dfa.hpp"
+#include "LexFileParser.hpp"
+
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Finds the DFA states where the scanner has to back up: non-accepting
+// states that a scan can reach after passing an accepting one. Stopping
+// there, on a dead transition or at the end of the input, rewinds to the last
+// accepting position, which is what the last-accept bookkeeping of the
+// scanner is for. Stopping before any accept is not backing up: the default
+// rule then takes one byte, which needs no record. In flex the default rule
+// is part of the automaton, so flex also reports states only reached that way.
+class BackupAnalysis {
+	public:
+		struct State {
+			Dfa::StateId state;
+			// shortest input, from the start of this condition (and of a
+			// line), that ends in the state after passing an accepting one
+			size_t condition;
+			bool atLineStart;
+			std::string example;
+			// the match the example backs up to
+			size_t backupLength;
+			int32_t backupRule;
+		};
+
+		BackupAnalysis();
+		~BackupAnalysis();
+
+		void analyze(const Dfa &dfa);
+
+		const std::vector<State> &getStates() const;
+		bool empty() const;
+
+		// a report in the style of flex -b: for each state, the rules that
+		// can still match from it, an example, and its live and jamming bytes
+		void writeReport(std::ostream &out, const Dfa &dfa, const LexFileParser::Content &content) const;
+
+		// text as a C string literal, with octal escapes for unprintable bytes
+		static std::string quote(std::string_view text);
+
+	private:
+		std::vector<State> _states;
+};
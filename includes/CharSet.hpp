@@ -0,0 +1,157 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// A set of bytes as a 256-bit bitmap. The set algebra works a 64-bit word at
+// a time, so comparing or splitting two classes costs four word operations
+// instead of a walk over their bytes or ranges.
+class CharSet {
+	public:
+		constexpr static size_t WORDS = 4;
+
+		struct Hash {
+			size_t operator()(const CharSet &set) const {
+				uint64_t h = 0;
+				for (uint64_t word : set._words) {
+					h = (h ^ word) * 0x9E3779B97F4A7C15ULL;
+				}
+				return static_cast<size_t>(h ^ (h >> 32));
+			}
+		};
+
+		static CharSet single(uint8_t byte) {
+			CharSet set;
+			set.add(byte);
+			return set;
+		}
+		static CharSet range(uint8_t lo, uint8_t hi) {
+			CharSet set;
+			set.addRange(lo, hi);
+			return set;
+		}
+		static CharSet all() {
+			return ~CharSet();
+		}
+
+		void add(uint8_t byte) {
+			_words[byte >> 6] |= 1ULL << (byte & 63);
+		}
+		void addRange(uint8_t lo, uint8_t hi) {
+			for (size_t w = lo >> 6; w <= static_cast<size_t>(hi >> 6); ++w) {
+				uint64_t mask = ~0ULL;
+				if (w == static_cast<size_t>(lo >> 6)) {
+					mask &= ~0ULL << (lo & 63);
+				}
+				if (w == static_cast<size_t>(hi >> 6)) {
+					mask &= ~0ULL >> (63 - (hi & 63));
+				}
+				_words[w] |= mask;
+			}
+		}
+		bool contains(uint8_t byte) const {
+			return (_words[byte >> 6] >> (byte & 63)) & 1;
+		}
+		bool empty() const {
+			return (_words[0] | _words[1] | _words[2] | _words[3]) == 0;
+		}
+		size_t count() const {
+			size_t total = 0;
+			for (uint64_t word : _words) {
+				total += static_cast<size_t>(__builtin_popcountll(word));
+			}
+			return total;
+		}
+		// the lowest member, -1 for the empty set
+		int first() const {
+			for (size_t w = 0; w < WORDS; ++w) {
+				if (_words[w] != 0) {
+					return static_cast<int>(w * 64) + __builtin_ctzll(_words[w]);
+				}
+			}
+			return -1;
+		}
+
+		CharSet &operator|=(const CharSet &other) {
+			for (size_t w = 0; w < WORDS; ++w) {
+				_words[w] |= other._words[w];
+			}
+			return *this;
+		}
+		CharSet &operator&=(const CharSet &other) {
+			for (size_t w = 0; w < WORDS; ++w) {
+				_words[w] &= other._words[w];
+			}
+			return *this;
+		}
+		// difference
+		CharSet &operator-=(const CharSet &other) {
+			for (size_t w = 0; w < WORDS; ++w) {
+				_words[w] &= ~other._words[w];
+			}
+			return *this;
+		}
+		CharSet operator~() const {
+			CharSet set;
+			for (size_t w = 0; w < WORDS; ++w) {
+				set._words[w] = ~_words[w];
+			}
+			return set;
+		}
+		friend CharSet operator|(CharSet a, const CharSet &b) { return a |= b; }
+		friend CharSet operator&(CharSet a, const CharSet &b) { return a &= b; }
+		friend CharSet operator-(CharSet a, const CharSet &b) { return a -= b; }
+		bool operator==(const CharSet &other) const = default;
+
+		// calls f(lo, hi) for each maximal run of members, in increasing order
+		template <typename F>
+		void forEachRange(F f) const {
+			int c = 0;
+			while (c < 256) {
+				uint64_t word = _words[c >> 6] >> (c & 63);
+				if (word == 0) {
+					c = (c | 63) + 1;
+					continue;
+				}
+				c += __builtin_ctzll(word);
+				int lo = c;
+				while (c < 256) {
+					uint64_t rest = ~_words[c >> 6] >> (c & 63);
+					if (rest != 0) {
+						c += __builtin_ctzll(rest);
+						break;
+					}
+					c = (c | 63) + 1;
+				}
+				f(static_cast<uint8_t>(lo), static_cast<uint8_t>(c - 1));
+			}
+		}
+
+	private:
+		std::array<uint64_t, WORDS> _words{};
+};
+
+// Interns character sets: equal sets get the same id, so later stages can
+// compare or index them by id.
+class CharSetTable {
+	public:
+		using SetId = uint32_t;
+		constexpr static SetId NO_SET = UINT32_MAX;
+
+		CharSetTable();
+		~CharSetTable();
+
+		SetId intern(const CharSet &set);
+		const CharSet &get(SetId id) const;
+
+		size_t size() const;
+		size_t bytesUsed() const;
+		void clear();
+
+	private:
+		std::vector<CharSet> _sets;
+		std::unordered_map<CharSet, SetId, CharSet::Hash> _ids;
+};
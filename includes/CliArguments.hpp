@@ -1,5 +1,11 @@
 #pragma once
 
+#include "CodeGenerator.hpp"
+#include "Dfa.hpp"
+#include "Interpreter.hpp"
+#include "LazyDfa.hpp"
+#include "Stats.hpp"
+
 #include <string>
 #include <vector>
 
@@ -10,11 +16,61 @@ class CliArguments {
 
 		bool parse();
 		std::string getInputFile() const;
+		bool isStatsEnabled() const;
+		Stats::Format getStatsFormat() const;
+		bool isAstPrintEnabled() const;
+		std::string getOutputFile() const;
+		CodeGenerator::TableMode getTableMode() const;
+		bool areSkipLoopsEnabled() const;
+		bool isOptimizationEnabled() const;
+		bool isKeywordTableEnabled() const;
+		bool isBackupReportEnabled() const;
+		bool isBackingUpAllowed() const;
+		LexFileParser::Content::ScannerStyle getScannerStyle(LexFileParser::Content::ScannerStyle fileStyle) const;
+		bool isReentrant(bool fileReentrant) const;
+		bool isRunEnabled() const;
+		bool isCountOnly() const;
+		size_t getCacheSize() const;
+		size_t getThreadCount() const;
+		Interpreter::EngineChoice getEngine() const;
+		size_t getDfaStateBudget() const;
+		size_t getDfaMemoryBudget() const;
+		// empty without --compile-cache
+		std::string getCompileCacheDirectory() const;
+		bool isCompileCacheCleared() const;
+		// the flags that change the automata, part of the compile cache key
+		std::string getAutomatonOptions() const;
 
 		void printUsage() const;
 
 	private:
+		constexpr static size_t MIN_CACHE_SIZE = 64 * 1024;
+		constexpr static size_t MIN_DFA_STATES = 256;
+		constexpr static size_t MIN_DFA_MEMORY = 1024 * 1024;
+
 		int	_argc;
 		std::vector<std::string>	_argv;
 		std::string	_inputFile;
+		bool	_stats = false;
+		Stats::Format	_statsFormat = Stats::TEXT;
+		bool	_printAst = false;
+		std::string	_outputFile = "lex.yy.c";
+		CodeGenerator::TableMode	_tableMode = CodeGenerator::COMPRESSED;
+		bool	_skipLoops = true;
+		bool	_optimize = true;
+		bool	_keywordTable = true;
+		bool	_backupReport = false;
+		bool	_backingUp = true;
+		bool	_styleSet = false;
+		LexFileParser::Content::ScannerStyle	_scannerStyle = LexFileParser::Content::TABLE_DRIVEN;
+		bool	_reentrant = false;
+		bool	_run = false;
+		bool	_countOnly = false;
+		size_t	_cacheSize = LazyDfa::DEFAULT_BUDGET;
+		size_t	_threads = 1;
+		Interpreter::EngineChoice	_engine = Interpreter::AUTO;
+		size_t	_dfaStates = Dfa::DEFAULT_STATE_BUDGET;
+		size_t	_dfaMemory = Dfa::DEFAULT_MEMORY_BUDGET;
+		std::string	_compileCache;
+		bool	_clearCompileCache = false;
 };
\ No newline at end of file
@@ -0,0 +1,115 @@
+#pragma once
+
+#include "BackupAnalysis.hpp"
+#include "Dfa.hpp"
+#include "KeywordTable.hpp"
+#include "LexFileParser.hpp"
+#include "Nfa.hpp"
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Emits a C scanner (lex.yy.c) for a minimized Dfa. Transitions are written
+// either as a full state x class matrix or as row-displacement compressed
+// tables in the style of flex: yy_base/yy_def/yy_nxt/yy_chk, where a state
+// only stores the entries in which it differs from its default state. A
+// direct-coded scanner instead turns each state into a block of goto code.
+// Rules the Dfa left out for going over its budget are matched by simulating
+// their part of the Nfa after the DFA matcher, which makes a hybrid scanner.
+// Keyword rules left out of the automaton by a KeywordTable are looked up
+// in the lexemes of their identifier rule once the match is known. When no
+// DFA state backs up, the matchers skip the last-accept record on every byte
+// and take the rule of the state the scan stops in.
+//
+// Every start condition gets its start state in the one automaton, so BEGIN
+// is a single store to yy_start. When rules are anchored with ^, each
+// condition has a second start state for the start of a line, picked by
+// yy_at_bol, which every token sets by whether it ends in a newline.
+//
+// A reentrant scanner keeps all of that state in a struct yyguts_t behind a
+// yyscan_t, and reads the same static const tables as every other scanner,
+// so independent scanners can run on as many threads as there are buffers.
+// The state is reached through macros named after the globals, which lets
+// both modes share one body of code.
+class CodeGenerator {
+	public:
+		enum TableMode {
+			FULL,
+			COMPRESSED
+		};
+
+		CodeGenerator(const LexFileParser::Content &content, const Dfa &dfa, const Nfa &nfa);
+		~CodeGenerator();
+
+		bool generate(std::ostream &out, TableMode mode, LexFileParser::Content::ScannerStyle style);
+
+		size_t getFullTableBytes() const;
+		size_t getCompressedTableBytes() const;
+		// the transitions and entries of the tables, checked against the
+		// %a and %o limits
+		size_t getTableTransitionCount(TableMode mode) const;
+		size_t getTableEntryCount(TableMode mode) const;
+		size_t getDirectCodeBytes() const;
+		size_t getSkipLoopCount() const;
+		const BackupAnalysis &getBackupAnalysis() const;
+
+		void setSkipLoopsEnabled(bool enabled);
+		void setKeywordTable(const KeywordTable &keywords);
+		void setReentrant(bool reentrant);
+
+	private:
+		// A state whose self-loop covers most of its live bytes. Its loop set
+		// is written as at most MAX_SKIP_RANGES byte ranges, or as the ranges
+		// of its complement when negate is set.
+		struct SkipLoop {
+			Dfa::StateId state;
+			bool negate;
+			std::vector<std::pair<uint8_t, uint8_t>> ranges;
+		};
+
+		const LexFileParser::Content &_content;
+		const Dfa &_dfa;
+		const Nfa &_nfa;
+
+		// compressed tables, built once by packTables()
+		std::vector<int> _base;
+		std::vector<int> _default;
+		std::vector<int> _next;
+		std::vector<int> _check;
+		size_t _packedEntries = 0;
+
+		std::vector<SkipLoop> _skipLoops;
+		std::vector<int> _skipIndex;
+		bool _skipLoopsEnabled = true;
+		const KeywordTable *_keywords = nullptr;
+		bool _reentrant = false;
+		BackupAnalysis _backup;
+
+		void packTables();
+		void findSkipLoops();
+		bool hasSkipLoops() const;
+		bool hasKeywords() const;
+		// the (condition, at line start) pairs the scanner picks its start
+		// state by, in the order of the expression startIndex() returns
+		std::vector<std::pair<size_t, bool>> startEntries() const;
+		std::string startIndex() const;
+		// the Nfa states of the fallback rules and of the shared prefixes,
+		// in the order the scanner numbers them
+		std::vector<Nfa::StateId> fallbackStates() const;
+		bool checkCapacity(TableMode mode) const;
+
+		void emitPrologue(std::ostream &out) const;
+		void emitScannerState(std::ostream &out) const;
+		void emitScannerApi(std::ostream &out) const;
+		void emitTables(std::ostream &out, TableMode mode) const;
+		std::string tableMatcher() const;
+		std::string directMatcher() const;
+		void emitScanner(std::ostream &out, const std::string &matcher, bool direct) const;
+		void emitSkipLoops(std::ostream &out) const;
+		void emitNfaFallback(std::ostream &out) const;
+		void emitKeywordLookup(std::ostream &out) const;
+		void emitParallelScan(std::ostream &out) const;
+		void emitActions(std::ostream &out) const;
+		void emitEpilogue(std::ostream &out) const;
+};
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "LexFileParser.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+class Nfa;
+class Dfa;
+class KeywordTable;
+
+// On-disk cache of the automata of a .l file, so that a file whose rules did
+// not change skips regex parsing, the NFA, the DFA and minimization, and only
+// runs code generation with its current actions and code.
+//
+// An entry is keyed by everything the automata depend on: the patterns, their
+// order, anchors and start conditions, the substitutions, the start condition
+// declarations, the % limits and the command line flags that shape the
+// automata, but no action or code. The key also holds the cache format and a
+// stamp of the ft_lex executable, so that a rebuilt ft_lex misses. Entries
+// are named by a hash of the key and store the key itself, so that a hash
+// collision is a miss rather than a wrong automaton.
+class CompileCache {
+	public:
+		// Binary encoding of an entry, in host byte order: an entry is only
+		// read back by the build of ft_lex that wrote it.
+		class Writer {
+			public:
+				void put(uint64_t value);
+				void put(std::string_view text);
+				void put(const std::vector<bool> &values);
+				template <typename T>
+				void put(const std::vector<T> &values) {
+					static_assert(std::is_trivially_copyable_v<T>);
+					put(static_cast<uint64_t>(values.size()));
+					_data.append(reinterpret_cast<const char *>(values.data()), values.size() * sizeof(T));
+				}
+
+				const std::string &getData() const;
+
+			private:
+				std::string _data;
+		};
+
+		// Reads what a Writer wrote; every get() is false once the data is
+		// short or inconsistent.
+		class Reader {
+			public:
+				Reader(std::string_view data);
+
+				bool get(uint64_t &value);
+				bool get(std::string &text);
+				bool get(std::vector<bool> &values);
+				template <typename T>
+				bool get(std::vector<T> &values) {
+					static_assert(std::is_trivially_copyable_v<T>);
+					uint64_t size;
+					if (!get(size) || size > (_data.size() - _position) / sizeof(T)) {
+						return false;
+					}
+					values.resize(size);
+					std::memcpy(values.data(), _data.data() + _position, size * sizeof(T));
+					_position += size * sizeof(T);
+					return true;
+				}
+				bool atEnd() const;
+
+			private:
+				std::string_view _data;
+				size_t _position = 0;
+		};
+
+		// an empty directory disables the cache
+		CompileCache(const std::string &directory);
+		~CompileCache();
+
+		bool isEnabled() const;
+		// options: the command line flags that change the automata
+		void setKey(const LexFileParser::Content &content, const std::string &options);
+
+		// false on a miss, which leaves the automata to be built
+		bool load(Nfa &nfa, Dfa &dfa, KeywordTable &keywords, size_t &statesBeforeMinimization) const;
+		// a failure to write only costs the next run a miss, and is a warning
+		void store(const Nfa &nfa, const Dfa &dfa, const KeywordTable &keywords, size_t statesBeforeMinimization) const;
+		// removes every entry of the directory
+		bool clear() const;
+
+		std::string getEntryPath() const;
+
+	private:
+		constexpr static uint64_t FORMAT_VERSION = 1;
+		constexpr static std::string_view MAGIC = "ft_lex compile cache\n";
+		constexpr static std::string_view EXTENSION = ".dfa";
+
+		std::string _directory;
+		std::string _key;
+		uint64_t _hash = 0;
+};
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "LexFileParser.hpp"
+#include "Nfa.hpp"
+
+#include <array>
+#include <cstdint>
+#include <unordered_set>
+#include <vector>
+
+// Deterministic automaton built from an Nfa by subset construction. Input
+// bytes are first partitioned into equivalence classes (bytes that no
+// character set of the file tells apart) and transitions are indexed by class
+// id: the row of state s is transitions[s * classCount .. (s + 1) * classCount).
+// State 0 is the dead state, every transition that fails leads there.
+//
+// Construction runs under a state and memory budget. When a build goes over
+// it, the rule whose states take the most distinct combinations in the
+// subsets built so far is blamed, left out, and construction starts again;
+// the rules left out are matched by NFA simulation in the generated scanner.
+class Dfa {
+	public:
+		using StateId = uint32_t;
+		constexpr static StateId DEAD_STATE = 0;
+		constexpr static int32_t NO_RULE = Nfa::NO_RULE;
+		constexpr static size_t DEFAULT_STATE_BUDGET = 65536;
+		constexpr static size_t DEFAULT_MEMORY_BUDGET = 128 * 1024 * 1024;
+
+		Dfa();
+		~Dfa();
+
+		void setBudget(size_t states, size_t bytes);
+		bool build(const Nfa &nfa, const LexFileParser::Content &content);
+		// Hopcroft partition refinement, returns the state count before it ran
+		size_t minimize();
+
+		size_t getStateCount() const;
+		size_t getClassCount() const;
+		size_t getCharacterSetCount() const;
+		size_t bytesUsed() const;
+		// rules left out of the automaton, see above
+		const std::vector<bool> &getFallbackRules() const;
+		size_t getFallbackCount() const;
+		// the warnings of build() about the rules left out, again
+		void reportFallbackRules(const LexFileParser::Content &content) const;
+
+		uint16_t getClass(uint8_t byte) const;
+		const std::array<uint16_t, 256> &getClassMap() const;
+		StateId getTransition(StateId state, uint16_t byteClass) const;
+		int32_t getAcceptRule(StateId state) const;
+		StateId getStartState(size_t condition, bool atLineStart = false) const;
+		// the number of start conditions
+		size_t getStartStateCount() const;
+		// the states of one minimized DFA per start condition, summed: the
+		// states reachable from the condition's start states and a dead state
+		size_t getSeparateStateCount() const;
+
+		// the minimized automaton of a compile cache entry; load() is false
+		// when the entry is damaged
+		void save(CompileCache::Writer &out) const;
+		bool load(CompileCache::Reader &in);
+
+		// byte classes of an Nfa, numbered by their lowest byte; returns the class count
+		static size_t computeClasses(const Nfa &nfa, std::array<uint16_t, 256> &classMap, size_t &characterSetCount);
+		// epsilon closure of states, reduced to its consuming or accepting states and sorted
+		static void closure(const Nfa &nfa, std::vector<Nfa::StateId> &states, std::vector<uint32_t> &marks, uint32_t generation);
+
+	private:
+		// Interned NFA state sets, stored back to back in _setData.
+		struct SetHash {
+			const Dfa *dfa;
+			size_t operator()(StateId id) const;
+		};
+		struct SetEqual {
+			const Dfa *dfa;
+			bool operator()(StateId a, StateId b) const;
+		};
+
+		// rough cost of one entry of the interning hash set
+		constexpr static size_t SET_ENTRY_BYTES = 32;
+
+		size_t _stateBudget = DEFAULT_STATE_BUDGET;
+		size_t _memoryBudget = DEFAULT_MEMORY_BUDGET;
+		std::vector<bool> _fallbackRules;
+
+		std::array<uint16_t, 256> _classMap{};
+		size_t _classCount = 0;
+		size_t _characterSetCount = 0;
+
+		std::vector<StateId> _transitions;
+		std::vector<int32_t> _acceptRule;
+		// two per start condition, as in the Nfa
+		std::vector<StateId> _startStates;
+
+		std::vector<Nfa::StateId> _setData;
+		std::vector<uint32_t> _setOffsets;
+
+		StateId intern(std::unordered_set<StateId, SetHash, SetEqual> &sets, const Nfa &nfa, const std::vector<Nfa::StateId> &states);
+		// subset construction without the fallback rules, false over budget
+		bool construct(const Nfa &nfa, const std::vector<uint32_t> &ruleOf);
+		size_t findExplodingRule(const std::vector<uint32_t> &ruleOf) const;
+		void warnFallback(const LexFileParser::Content &content, size_t rule) const;
+};
@@ -0,0 +1,115 @@
+#pragma once
+
+#include "LexFileParser.hpp"
+#include "RegexParser.hpp"
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+class RegexArena;
+
+// Position (Glushkov) automaton of the rules active in INITIAL, simulated
+// with bit-parallel operations instead of being determinized. Position 0 is
+// the initial position, position 1 the one at the start of a line when a rule
+// is anchored with ^, and every character of a pattern gets one more. The
+// set of live positions fits in up to MAX_WORDS 64-bit words; one step is
+//     live' = follow(live) & positionsOf[byte]
+// where follow(live) is read from tables indexed by each byte of live.
+class GlushkovMatcher {
+	public:
+		constexpr static size_t MAX_WORDS = 2;
+		constexpr static size_t MAX_POSITIONS = MAX_WORDS * 64;
+		constexpr static int32_t NO_RULE = -1;
+
+		// Scanning interface shared with the lazy DFA: a state is the set of
+		// live positions.
+		template <size_t Words>
+		class Engine {
+			public:
+				using State = std::array<uint64_t, Words>;
+
+				explicit Engine(const GlushkovMatcher &matcher) : _matcher(&matcher) {}
+
+				State start(bool atLineStart) const {
+					State state{};
+					state[0] = _matcher->_lineStart && atLineStart ? 2 : 1;
+					return state;
+				}
+				// false once no position is live
+				bool next(State &state, uint8_t byte) const {
+					State following{};
+					const uint64_t *follow = _matcher->_follow.data();
+					for (size_t block = 0; block < _matcher->_blocks; ++block) {
+						uint64_t bits = (state[block >> 3] >> ((block & 7) * 8)) & 0xFF;
+						const uint64_t *entry = &follow[(block * 256 + bits) * Words];
+						for (size_t w = 0; w < Words; ++w) {
+							following[w] |= entry[w];
+						}
+					}
+					const uint64_t *positions = &_matcher->_positionsOf[byte * Words];
+					uint64_t live = 0;
+					for (size_t w = 0; w < Words; ++w) {
+						following[w] &= positions[w];
+						live |= following[w];
+					}
+					state = following;
+					return live != 0;
+				}
+				// positions are numbered in rule order, so the lowest accepting
+				// one belongs to the earliest rule
+				int32_t accept(const State &state) const {
+					for (size_t w = 0; w < Words; ++w) {
+						uint64_t accepting = state[w] & _matcher->_acceptMask[w];
+						if (accepting != 0) {
+							return _matcher->_acceptRule[w * 64 + __builtin_ctzll(accepting)];
+						}
+					}
+					return NO_RULE;
+				}
+
+			private:
+				const GlushkovMatcher *_matcher;
+		};
+
+		GlushkovMatcher();
+		~GlushkovMatcher();
+
+		// false when the rules need more than MAX_POSITIONS positions
+		bool build(const LexFileParser::Content &content, const std::vector<RegexParser::NodeId> &roots, const RegexArena &arena);
+
+		size_t countPositions(const LexFileParser::Content &content, const std::vector<RegexParser::NodeId> &roots, const RegexArena &arena) const;
+		size_t getPositionCount() const;
+		size_t getWordCount() const;
+		size_t bytesUsed() const;
+
+	private:
+		using Bits = std::array<uint64_t, MAX_WORDS>;
+		struct Info {
+			Bits first;
+			Bits last;
+			bool nullable;
+		};
+
+		const RegexArena *_arena = nullptr;
+		bool _lineStart = false;
+		size_t _words = 0;
+		// bytes of the live set that hold positions
+		size_t _blocks = 0;
+		std::vector<Bits> _followOf;
+		std::vector<CharSet> _bytesOf;
+
+		// tables read by Engine, _words words per entry
+		std::vector<uint64_t> _follow;
+		std::vector<uint64_t> _positionsOf;
+		std::vector<uint64_t> _acceptMask;
+		std::vector<int32_t> _acceptRule;
+
+		static size_t countNode(const RegexArena &arena, RegexParser::NodeId id, std::vector<size_t> &memo);
+		size_t newPosition(const CharSet &members);
+		void addFollow(const Bits &from, const Bits &to);
+		Info buildNode(RegexParser::NodeId id);
+		Info buildAtom(const RegexParser::AtomNode &atom);
+		Info buildQuantifier(const RegexParser::QuantifierNode &quantifier);
+		void buildTables();
+};
@@ -0,0 +1,143 @@
+#pragma once
+
+#include "GlushkovMatcher.hpp"
+#include "LazyDfa.hpp"
+#include "LexFileParser.hpp"
+#include "Nfa.hpp"
+
+#include <cstdio>
+#include <memory>
+#include <ostream>
+#include <vector>
+
+// Tokenizes input with a LazyDfa, or with a GlushkovMatcher when one is
+// given, instead of a generated scanner. Matching
+// follows the generated code: longest match, then the earliest rule, and a
+// byte that starts no match is a token of the default rule. Actions are not
+// run, so the scan stays in the INITIAL start condition. A token starts a
+// line at the start of the input and after a newline.
+//
+// With several threads the input is read in windows cut into chunks. Every
+// chunk is tokenized speculatively from its first byte, as if a token began
+// there, each worker with its own LazyDfa. The chunks are then stitched in
+// order: where the token stream coming from the previous chunk lands on a
+// token start of the next one, both scans agree from there on; otherwise
+// the stitcher rescans sequentially until the two streams meet.
+class Interpreter {
+	public:
+		enum EngineChoice {
+			AUTO,
+			LAZY_DFA,
+			GLUSHKOV
+		};
+
+		// glushkov may be null; when set it replaces the lazy automata
+		Interpreter(const LexFileParser::Content &content, const Nfa &nfa, const GlushkovMatcher *glushkov, size_t cacheBudget, size_t threadCount);
+		~Interpreter();
+
+		// prints "<rule>\t<lexeme>" per token, or only the per-rule counts
+		bool run(std::FILE *input, std::ostream &out, bool countOnly);
+
+		size_t getTokenCount() const;
+		size_t getByteCount() const;
+		size_t getClassCount() const;
+		size_t getBuiltCount() const;
+		size_t getCachedCount() const;
+		size_t getFlushCount() const;
+		size_t getCacheBytes() const;
+		size_t getCacheBudget() const;
+		bool isGlushkov() const;
+
+		size_t getThreadCount() const;
+		size_t getChunkCount() const;
+		size_t getStealCount() const;
+		size_t getRescannedBytes() const;
+		double getScanTime() const;
+
+	private:
+		constexpr static size_t READ_SIZE = 1024 * 1024;
+		constexpr static size_t WINDOW_PER_THREAD = 8 * 1024 * 1024;
+		constexpr static size_t CHUNKS_PER_THREAD = 4;
+
+		// the scanning interface of GlushkovMatcher::Engine over a LazyDfa
+		class LazyDfaEngine {
+			public:
+				using State = LazyDfa::StateId;
+
+				explicit LazyDfaEngine(LazyDfa &dfa) : _dfa(&dfa) {}
+
+				State start(bool atLineStart) {
+					return _dfa->getStartState(0, atLineStart);
+				}
+				bool next(State &state, uint8_t byte) {
+					state = _dfa->next(state, byte);
+					return state != LazyDfa::DEAD_STATE;
+				}
+				int32_t accept(State state) const {
+					return _dfa->getAcceptRule(state);
+				}
+
+			private:
+				LazyDfa *_dfa;
+		};
+
+		struct Token {
+			size_t start;
+			size_t length;
+			size_t rule;
+		};
+		// Speculative tokens of one chunk. end is where the chunk stopped:
+		// past its last byte, or at the start of a token that ran into the
+		// end of the window before the end of input (open).
+		struct Chunk {
+			size_t begin;
+			size_t limit;
+			std::vector<Token> tokens;
+			size_t end;
+			bool open;
+			double time;
+		};
+
+		const LexFileParser::Content &_content;
+		size_t _threadCount;
+		const GlushkovMatcher *_glushkov;
+		// one lazy automaton per worker, the last one belongs to the caller;
+		// none when scanning with _glushkov
+		std::vector<std::unique_ptr<LazyDfa>> _dfas;
+		std::FILE *_input = nullptr;
+
+		std::vector<char> _buffer;
+		size_t _length = 0;
+		size_t _position = 0;
+		bool _eof = false;
+		// whether the byte before _buffer[0], if any, ends a line
+		bool _lineStart = true;
+
+		std::vector<size_t> _counts;
+		size_t _tokens = 0;
+		size_t _bytes = 0;
+
+		size_t _chunks = 0;
+		size_t _steals = 0;
+		size_t _rescanned = 0;
+		double _scanTime = 0;
+
+		bool fill();
+		// whether a token starting at data[position] of the buffer starts a line
+		bool atLineStart(const char *data, size_t position) const;
+		// engines[worker] scans for one worker, engines.back() for the caller
+		template <typename Engine>
+		bool scan(std::vector<Engine> &engines, std::ostream &out, bool countOnly);
+		template <typename Engine>
+		bool runSequential(Engine &engine, std::ostream &out, bool countOnly);
+		template <typename Engine>
+		bool runParallel(std::vector<Engine> &engines, std::ostream &out, bool countOnly);
+		template <typename Engine>
+		bool scanToken(Engine &engine, const char *data, size_t start, size_t windowEnd, bool atEof, Token &token) const;
+		template <typename Engine>
+		void scanChunk(Engine &engine, const char *data, size_t windowEnd, bool atEof, Chunk &chunk) const;
+		template <typename Engine>
+		size_t stitch(Engine &engine, std::vector<Chunk> &chunks, size_t windowEnd, bool atEof, std::ostream &out, bool countOnly);
+		void emit(std::ostream &out, bool countOnly, size_t rule, const char *text, size_t length);
+		void printCounts(std::ostream &out) const;
+};
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "CompileCache.hpp"
+#include "LexFileParser.hpp"
+#include "Nfa.hpp"
+#include "RegexParser.hpp"
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class RegexArena;
+
+// Takes keyword rules out of the automaton. A rule whose whole pattern is a
+// string of two or more bytes, not anchored with ^, is a keyword when, without
+// the keyword rules, its string is matched by one later rule, the identifier
+// rule, in every start condition the keyword is active in, and in no other,
+// at the start of a line or not. The keyword then
+// changes nothing about the longest match, only which rule gets it: the
+// scanner runs the identifier rule's lexemes through a lookup of the
+// keywords and hands a hit to the keyword rule, keeping flex's priorities.
+class KeywordTable {
+	public:
+		struct Keyword {
+			std::string text;
+			size_t rule;
+		};
+		// A hash-and-displace perfect hash of one identifier rule's
+		// keywords: a keyword hashes to bucket mix(h) % buckets, and lands
+		// on slot mix(h + d * DISPLACEMENT_STEP) % slots, where h is
+		// hash(text, seed) and d the displacement of its bucket. No two
+		// keywords share a slot, so a lookup compares one keyword at most.
+		struct PerfectHash {
+			uint64_t seed = 0;
+			std::vector<uint32_t> displacements;
+			// keyword index by slot, -1 for a free slot
+			std::vector<int32_t> slots;
+		};
+		constexpr static uint64_t DISPLACEMENT_STEP = 0x9e3779b97f4a7c15ULL;
+
+		KeywordTable();
+		~KeywordTable();
+
+		// false when the automaton without the keywords cannot be built
+		bool build(const LexFileParser::Content &content, const std::vector<RegexParser::NodeId> &roots, const RegexArena &arena);
+
+		// the keyword rules, by rule index
+		const std::vector<bool> &getRules() const;
+		// the keywords checked by each identifier rule, sorted by length and
+		// then text
+		const std::map<size_t, std::vector<Keyword>> &getTables() const;
+		size_t getKeywordCount() const;
+		bool empty() const;
+
+		// FNV-1a from a seeded basis and the murmur3 finalizer; the generated
+		// scanner has the same two functions
+		static uint64_t hash(std::string_view text, uint64_t seed);
+		static uint64_t mix(uint64_t h);
+		static PerfectHash buildPerfectHash(const std::vector<Keyword> &keywords);
+
+		// the table of a compile cache entry; false when the entry is damaged
+		void save(CompileCache::Writer &out) const;
+		bool load(CompileCache::Reader &in);
+
+	private:
+		std::vector<bool> _rules;
+		std::map<size_t, std::vector<Keyword>> _tables;
+		size_t _keywordCount = 0;
+
+		static int32_t match(const Nfa &nfa, size_t condition, bool atLineStart, std::string_view text, std::vector<uint32_t> &marks,
+			uint32_t &generation);
+};
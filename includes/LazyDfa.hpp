@@ -0,0 +1,79 @@
+#pragma once
+
+#include "Nfa.hpp"
+
+#include <array>
+#include <cstdint>
+#include <unordered_set>
+#include <vector>
+
+// Dfa built on demand while scanning: a state, and each of its transitions,
+// is only computed the first time the input reaches it. Materialized states
+// live in a cache with a fixed memory budget; when adding a state would go
+// over it, the whole cache is flushed and rebuilding starts again from the
+// state being added, as RE2 does.
+class LazyDfa {
+	public:
+		using StateId = uint32_t;
+		constexpr static StateId DEAD_STATE = 0;
+		constexpr static int32_t NO_RULE = Nfa::NO_RULE;
+		constexpr static size_t DEFAULT_BUDGET = 8 * 1024 * 1024;
+
+		LazyDfa(const Nfa &nfa, size_t budget);
+		~LazyDfa();
+
+		StateId getStartState(size_t condition, bool atLineStart = false);
+		// the returned state is valid, any other id held by the caller may
+		// have been invalidated by a flush
+		StateId next(StateId state, uint8_t byte) {
+			StateId target = _transitions[state * _classCount + _classMap[byte]];
+			return target != UNKNOWN ? target : materialize(state, byte);
+		}
+		int32_t getAcceptRule(StateId state) const {
+			return _acceptRule[state];
+		}
+
+		size_t getClassCount() const;
+		size_t getStateCount() const;
+		size_t getBuiltCount() const;
+		size_t getFlushCount() const;
+		size_t getBudget() const;
+		size_t bytesUsed() const;
+
+	private:
+		constexpr static StateId UNKNOWN = UINT32_MAX;
+		// rough cost of one entry of the interning hash set
+		constexpr static size_t SET_ENTRY_BYTES = 32;
+
+		struct SetHash {
+			const LazyDfa *dfa;
+			size_t operator()(StateId id) const;
+		};
+		struct SetEqual {
+			const LazyDfa *dfa;
+			bool operator()(StateId a, StateId b) const;
+		};
+
+		const Nfa &_nfa;
+		size_t _budget;
+		std::array<uint16_t, 256> _classMap{};
+		size_t _classCount = 0;
+
+		std::vector<StateId> _transitions;
+		std::vector<int32_t> _acceptRule;
+		std::vector<StateId> _startStates;
+		std::vector<Nfa::StateId> _setData;
+		std::vector<uint32_t> _setOffsets;
+		std::unordered_set<StateId, SetHash, SetEqual> _sets;
+
+		std::vector<uint32_t> _marks;
+		uint32_t _generation = 0;
+		std::vector<Nfa::StateId> _work;
+
+		size_t _built = 0;
+		size_t _flushes = 0;
+
+		StateId materialize(StateId state, uint8_t byte);
+		StateId intern(const std::vector<Nfa::StateId> &states);
+		void flush();
+};
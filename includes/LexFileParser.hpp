@@ -1,9 +1,13 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <map>
+#include <unordered_map>
 
+// Every string of the Content is a view into the .l file, which is mapped
+// or read once: the parser must outlive its Content.
 class LexFileParser {
 	public:
 		struct Content {
@@ -11,39 +15,57 @@ class LexFileParser {
 				ARRAY,
 				POINTER
 			};
+			enum ScannerStyle {
+				TABLE_DRIVEN,
+				DIRECT_CODED
+			};
 			struct StartCondition {
-				std::string name;
+				std::string_view name;
 				bool inclusive;
 			};
 
-			std::vector<std::string> definitionCode;
+			std::vector<std::string_view> definitionCode;
 			YytextType yytextType = POINTER;
+			ScannerStyle scannerStyle = TABLE_DRIVEN;
+			size_t bufferSize = 1024 * 1024;
+			// %option reentrant: the scanner state lives in a yyscan_t
+			bool reentrant = false;
 			size_t positionsSize = 5000;
 			size_t statesSize = 1000;
 			size_t transitionsSize = 4000;
 			size_t parseTreeSize = 2000;
 			size_t packedCharacterClassesSize = 2000;
 			size_t outputArraySize = 6000;
-			std::map<std::string, std::string> substitutions;
+			std::map<std::string_view, std::string_view> substitutions;
 			std::vector<StartCondition> startConditions = { {"INITIAL", true}  };
 
 			struct Rule {
-				std::string pattern;
-				std::string action;
-				std::vector<std::string> startConditions;
+				std::string_view pattern;
+				// the lines of a multi-line action stay one span, newlines
+				// included
+				std::string_view action;
+				std::vector<std::string_view> startConditions;
+				// line of the pattern in the .l file, for diagnostics
+				size_t line;
+				// the pattern began with ^: the rule only matches at the
+				// start of a line
+				bool lineStart;
 			};
 
 			std::vector<Rule> rules;
 
-			std::vector<std::string> userSubroutinesCode;
+			std::vector<std::string_view> userSubroutinesCode;
 		};
 	
 		LexFileParser(const std::string& filename);
 		~LexFileParser();
 
+		LexFileParser(const LexFileParser &) = delete;
+		LexFileParser &operator=(const LexFileParser &) = delete;
+
 		bool parse();
 
-		Content getContent() const;
+		const Content &getContent() const;
 		void show() const;
 
 	private:
@@ -60,12 +82,38 @@ class LexFileParser {
 		constexpr static size_t MIN_PACKED_CHARACTER_CLASSES_SIZE = 1000;
 		constexpr static size_t MIN_OUTPUT_ARRAY_SIZE = 3000;
 
+		// Where the C code of an action stands at the end of the lines fed
+		// so far, so that each line of a long action is scanned once.
+		struct ActionScanner {
+			bool inSimpleQuote = false;
+			bool inDoubleQuote = false;
+			bool inComment = false;
+			int depth = 0;
+
+			void feed(std::string_view text);
+			bool isFinished() const;
+		};
+
 		std::string _filename;
+		// the mapped file, or _text when it could not be mapped
+		const char *_mapping = nullptr;
+		size_t _mappingSize = 0;
+		std::string _text;
 		State _state;
 		Content _content;
 		bool _isValid;
+		size_t _lineNumber = 0;
+		bool _insideCodeBlock = false;
+		// the rule whose action continues on the next lines, if any
+		Content::Rule _currentRule = { "", "", {}, 0, false };
+		bool _insideAction = false;
+		ActionScanner _action;
+		// start condition name to its index in _content.startConditions
+		std::unordered_map<std::string_view, size_t> _startConditionIndex;
 
-		void handleDefinitionLine(const std::string& line);
-		void handleRuleLine(const std::string& line);
-		void handleUserSubroutineLine(const std::string& line);
+		bool load(std::string_view &text);
+		void handleDefinitionLine(std::string_view line);
+		void handleOptionLine(std::string_view line);
+		void handleRuleLine(std::string_view line);
+		void handleUserSubroutineLine(std::string_view line);
 };
\ No newline at end of file
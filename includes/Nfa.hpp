@@ -0,0 +1,139 @@
+#pragma once
+
+#include "CompileCache.hpp"
+#include "LexFileParser.hpp"
+#include "RegexParser.hpp"
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+class RegexArena;
+
+// Thompson NFA combining every rule of a .l file. Edges are kept in CSR form:
+// the edges leaving state s are edges[offsets[s] .. offsets[s + 1]), one array
+// for epsilon edges and one for edges labelled with a character set, by id in
+// the NFA's CharSetTable (the arena's sets plus those of string letters). Each start condition gets its
+// own start state with epsilon edges to the rules active in it. When some
+// rule is anchored with ^, each condition also gets a start state for the
+// start of a line, with an epsilon edge to the other one and edges to the
+// anchored rules, which the first one lacks. A rule's
+// priority is its index in Content::rules: the lower index wins. The states
+// of a rule are numbered contiguously, after the start states and the shared
+// states.
+//
+// Rules active in the same start conditions whose patterns begin with a
+// literal starting with the same byte share the states of those literals: a
+// trie, entered from the start states, in place of one chain per rule. The
+// rest of each pattern hangs off the trie node where its literal ends.
+//
+// Rules marked with setLeftOutRules() get no states and never match.
+class Nfa {
+	public:
+		using StateId = uint32_t;
+		constexpr static int32_t NO_RULE = -1;
+		constexpr static StateId NO_STATE = UINT32_MAX;
+
+		struct SetEdge {
+			StateId target;
+			CharSetTable::SetId set;
+		};
+
+		Nfa();
+		~Nfa();
+
+		bool build(const LexFileParser::Content &content, const std::vector<RegexParser::NodeId> &roots, const RegexArena &arena);
+		// rules to leave out of the next build(), by rule index
+		void setLeftOutRules(const std::vector<bool> &rules);
+
+		// whether the rule is active in the start condition
+		static bool isActive(const LexFileParser::Content &content, size_t rule, size_t condition);
+
+		size_t getStateCount() const;
+		size_t getEpsilonCount() const;
+		size_t getSetEdgeCount() const;
+		size_t getPositionCount() const;
+		size_t getRuleCount() const;
+		size_t bytesUsed() const;
+
+		std::span<const StateId> getEpsilonEdges(StateId state) const;
+		std::span<const SetEdge> getSetEdges(StateId state) const;
+		const CharSet &getSet(CharSetTable::SetId id) const;
+		size_t getSetCount() const;
+		int32_t getAcceptRule(StateId state) const;
+		StateId getStartState(size_t condition, bool atLineStart = false) const;
+		// the number of start conditions
+		size_t getStartStateCount() const;
+		// whether the start states at the start of a line differ
+		bool hasLineStartRules() const;
+		// the states of rule r are [first, second)
+		std::pair<StateId, StateId> getRuleStates(size_t rule) const;
+		// the prefix trie states, belonging to no rule
+		std::pair<StateId, StateId> getSharedStates() const;
+
+		// what code generation reads of a built Nfa, for a compile cache entry;
+		// a loaded Nfa cannot be built on. load() is false when the entry is
+		// damaged
+		void save(CompileCache::Writer &out) const;
+		bool load(CompileCache::Reader &in);
+
+	private:
+		struct Fragment {
+			StateId start;
+			StateId end;
+		};
+		// a lowered sub-automaton: its states and the pending edges it added
+		struct Template {
+			Fragment fragment;
+			StateId firstState;
+			StateId endState;
+			size_t firstEpsilon;
+			size_t endEpsilon;
+			size_t firstSetEdge;
+			size_t endSetEdge;
+		};
+
+		const RegexArena *_arena = nullptr;
+		size_t _ruleCount = 0;
+		// lowering gives up well past the %n limit instead of running out of memory
+		size_t _stateLimit = SIZE_MAX;
+		std::vector<StateId> _ruleBegin;
+		std::vector<bool> _leftOut;
+		StateId _sharedBegin = 0;
+		StateId _sharedEnd = 0;
+
+		std::vector<int32_t> _acceptRule;
+		// two per start condition: condition * 2 + atLineStart
+		std::vector<StateId> _startStates;
+		bool _lineStart = false;
+		CharSetTable _sets;
+		// set ids of the string letters, interned on first use
+		std::array<CharSetTable::SetId, 256> _singletons;
+
+		std::vector<uint32_t> _epsilonOffsets;
+		std::vector<StateId> _epsilonTargets;
+		std::vector<uint32_t> _setOffsets;
+		std::vector<SetEdge> _setEdges;
+
+		// edge lists collected while lowering, packed into CSR by finalize()
+		std::vector<std::pair<StateId, StateId>> _pendingEpsilon;
+		std::vector<std::pair<StateId, SetEdge>> _pendingSets;
+
+		StateId newState();
+		void addEpsilon(StateId from, StateId to);
+		void addSet(StateId from, StateId to, CharSetTable::SetId set);
+		CharSetTable::SetId singleton(uint8_t byte);
+
+		Fragment lower(RegexParser::NodeId id);
+		Fragment lowerAtom(const RegexParser::AtomNode &atom);
+		Fragment lowerQuantifier(const RegexParser::QuantifierNode &quantifier);
+		Fragment lowerRange(const RegexParser::QuantifierNode &quantifier);
+		Fragment clone(const Template &body);
+		void buildPrefixTrie(const LexFileParser::Content &content, const std::vector<std::vector<RegexParser::NodeId>> &factors,
+			std::vector<StateId> &prefixEnd);
+
+		void finalize();
+		bool checkLimits(const LexFileParser::Content &content) const;
+		bool isLeftOut(size_t rule) const;
+};
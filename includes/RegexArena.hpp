@@ -0,0 +1,67 @@
+#pragma once
+
+#include "RegexParser.hpp"
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+
+// Owns every RegexNode built while compiling one .l file. Nodes are stored
+// contiguously and addressed by 32-bit ids; since a child is always created
+// before its parent, walking ids in increasing order is a post-order walk.
+// Nodes are hash-consed: structurally equal sub-trees share one id, so the
+// rules of a file form a DAG rather than a forest. The character sets of the
+// atoms are interned too; classes are keyed by their set rather than their
+// text, so [a-c] and [abc] are one node.
+class RegexArena {
+	public:
+		using NodeId = RegexParser::NodeId;
+
+		RegexArena();
+		~RegexArena();
+
+		RegexArena(const RegexArena &) = delete;
+		RegexArena &operator=(const RegexArena &) = delete;
+
+		NodeId addNode(const RegexParser::RegexNode &node);
+		NodeId addAtom(RegexParser::AtomType type, std::string_view value);
+		NodeId addClass(std::string_view text, const CharSet &members);
+
+		const RegexParser::RegexNode &getNode(NodeId id) const;
+		std::string_view getValue(const RegexParser::AtomNode &atom) const;
+		const CharSet &getSet(CharSetTable::SetId id) const;
+		const CharSetTable &getSets() const;
+		// the factors of a chain of concatenations, left to right
+		void appendFactors(NodeId id, std::vector<NodeId> &factors) const;
+
+		size_t size() const;
+		size_t bytesUsed() const;
+		size_t getSharedHits() const;
+		void clear();
+
+	private:
+		struct NodeKey {
+			uint32_t type;
+			uint32_t a;
+			uint32_t b;
+			int min;
+			int max;
+
+			bool operator==(const NodeKey &other) const = default;
+		};
+		struct NodeKeyHash {
+			size_t operator()(const NodeKey &key) const;
+		};
+
+		std::vector<RegexParser::RegexNode> _nodes;
+		std::string _strings;
+		std::unordered_map<NodeKey, NodeId, NodeKeyHash> _internedNodes;
+		std::unordered_map<std::string, NodeId> _internedAtoms;
+		CharSetTable _sets;
+		std::unordered_map<CharSetTable::SetId, NodeId> _internedClasses;
+		size_t _sharedHits = 0;
+
+		NodeId push(const RegexParser::RegexNode &node);
+		static NodeKey makeKey(const RegexParser::RegexNode &node);
+};
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "RegexParser.hpp"
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+class RegexArena;
+
+// Rewrites regex trees into equivalent ones with fewer nodes before they are
+// lowered to the NFA. The arena only grows: rewritten nodes are added next to
+// the parsed ones and optimize() returns the new root. Within one rule only
+// the language of the pattern matters, so alternatives may be reordered.
+//   - adjacent literals are fused:          a"bc"\n      -> "abc\n"
+//   - nested quantifiers collapse:          (x+)*, x?*   -> x*
+//   - single-byte alternatives merge:       a|b|[0-9]    -> [0-9ab]
+//   - common prefixes are factored:         "=="|"="     -> "="("=")?
+// The empty string is the STRING atom "".
+class RegexOptimizer {
+	public:
+		using NodeId = RegexParser::NodeId;
+
+		explicit RegexOptimizer(RegexArena &arena);
+		~RegexOptimizer();
+
+		NodeId optimize(NodeId root);
+
+		// size of the trees under roots, a shared sub-tree counting once per
+		// occurrence since it is lowered once per occurrence
+		static size_t countNodes(const RegexArena &arena, const std::vector<NodeId> &roots);
+
+	private:
+		RegexArena &_arena;
+		NodeId _empty;
+		// result of optimize() by node id, NO_NODE until computed
+		std::vector<NodeId> _optimized;
+		// nullable() by node id: -1 until computed
+		std::vector<int8_t> _nullable;
+
+		NodeId rewrite(NodeId id);
+		NodeId concatenate(const std::vector<NodeId> &factors);
+		NodeId alternate(const std::vector<NodeId> &alternatives);
+		NodeId factorPrefixes(const std::vector<std::vector<NodeId>> &group);
+		NodeId quantify(NodeId inner, RegexParser::QuantifierType type, int min, int max);
+
+		void appendAlternatives(NodeId id, std::vector<NodeId> &alternatives) const;
+		bool isLiteral(NodeId id) const;
+		std::string_view literalText(NodeId id) const;
+		NodeId literal(std::string_view text);
+		// the bytes of an atom matching exactly one byte
+		bool singleByte(NodeId id, CharSet &bytes) const;
+		NodeId byteAtom(const CharSet &bytes);
+		bool nullable(NodeId id);
+
+		static std::string classText(const CharSet &bytes);
+};
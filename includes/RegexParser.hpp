@@ -1,16 +1,28 @@
 #pragma once
 
+#include "CharSet.hpp"
+
 #include <string>
+#include <string_view>
 #include <variant>
-#include <map>
+#include <cstdint>
+
+class RegexArena;
+class SubstitutionCache;
 
 class RegexParser {
 	public:
-		RegexParser(const std::string &pattern, const std::map<std::string, std::string> &substitutions);
+		using NodeId = uint32_t;
+		constexpr static NodeId NO_NODE = UINT32_MAX;
+
+		RegexParser(std::string_view pattern, SubstitutionCache &substitutions, RegexArena &arena);
 		~RegexParser();
 
 		bool parse();
 
+		constexpr static int UNBOUNDED = -1;
+		constexpr static int MAX_REPETITION = 32767;
+
 		enum AtomType {
 			WILDCARD,
 			CHARACTER,
@@ -30,48 +42,65 @@ class RegexParser {
 			ALTERNATION,
 			QUANTIFIER
 		};
-		struct RegexNode;
+		// Atom text lives in the arena string pool, see RegexArena::getValue.
+		// Atoms matching one byte (all but STRING) also carry their
+		// character set, interned in the arena, see RegexArena::getSet
 		struct AtomNode {
 			AtomType type;
-			std::string value;
+			uint32_t valueOffset;
+			uint32_t valueLength;
+			CharSetTable::SetId set;
 		};
 		struct ConcatenationNode {
-			RegexNode *left;
-			RegexNode *right;
+			NodeId left;
+			NodeId right;
 		};
 		struct AlternationNode {
-			RegexNode *left;
-			RegexNode *right;
+			NodeId left;
+			NodeId right;
 		};
 		struct QuantifierNode {
-			RegexNode *node;
+			NodeId node;
 			QuantifierType quantifierType;
 			int min; // use for RANGE
-			int max; // use for RANGE
+			int max; // use for RANGE, UNBOUNDED for {m,}
 		};
 		struct RegexNode {
 			NodeType type;
 			std::variant<AtomNode, ConcatenationNode, AlternationNode, QuantifierNode> data;
 		};
 
-		RegexNode* getRoot() const;
-	
-		void printNode(const RegexNode *node, int indent = 0) const;
+		NodeId getRoot() const;
+
+		// Decodes the escape sequence starting right after a backslash
+		static char decodeEscape(std::string_view text, size_t &position);
+		// Expands the text of a character class (without its brackets) to the
+		// bytes it matches
+		static CharSet decodeClass(std::string_view text);
+
+		void printNode(NodeId node, int indent = 0) const;
 		void printTree() const;
 
 	private:
 		std::string _pattern;
-		std::map<std::string, std::string> _substitutions;
-		RegexNode *_root = nullptr;
+		SubstitutionCache &_substitutions;
+		RegexArena &_arena;
+		NodeId _root = NO_NODE;
 		size_t _position = 0;
 
 		char peek() const;
 		void consume(char expected);
 
 		bool canStartAtom(char c) const;
+		bool atEnd() const;
+		char parseEscape();
+
+		NodeId makeAtom(AtomType type, const std::string &value);
 
-		RegexNode *parseAlternation();
-		RegexNode *parseConcatenation();
-		RegexNode *parseQuantifier();
-		RegexNode *parseAtom();
-};
\ No newline at end of file
+		NodeId parseAlternation();
+		NodeId parseConcatenation();
+		NodeId parseQuantifier();
+		int parseCount();
+		NodeId makeRange(NodeId atom, int min, int max);
+		NodeId parseAtom();
+};
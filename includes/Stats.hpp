@@ -0,0 +1,87 @@
+#pragma once
+
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// What --stats reports: the wall time and allocations of each pipeline
+// stage, named counters, and how much of each % directive limit the rules
+// use. It is written as text, or as one JSON object with --stats=json.
+//
+// Stages are timed by a Timer over a scope. A Timer given no Stats does
+// nothing but test the pointer, so the timers stay in every build. The
+// allocations are counted by the global operator new once
+// countAllocations() was called, and cost a relaxed load before.
+class Stats {
+	public:
+		enum Format {
+			TEXT,
+			JSON
+		};
+
+		class Timer {
+			public:
+				Timer(Stats *stats, const char *stage);
+				~Timer();
+
+				Timer(const Timer &) = delete;
+				Timer &operator=(const Timer &) = delete;
+
+				// records the stage now rather than at the end of the scope
+				void stop();
+
+			private:
+				Stats *_stats;
+				const char *_stage;
+				std::chrono::steady_clock::time_point _start;
+				size_t _allocations = 0;
+				size_t _bytes = 0;
+		};
+
+		Stats();
+		~Stats();
+
+		// unit is printed after the value and appended to the JSON key
+		void add(const std::string &name, size_t value, const std::string &unit = "");
+		void add(const std::string &name, double value, const std::string &unit = "");
+		void add(const std::string &name, const std::string &text);
+		// used against the limit of a % directive, as %n or %a
+		void addLimit(const std::string &directive, const std::string &name, size_t used, size_t limit);
+
+		// the peak resident set size of the process, when the system tells
+		void addPeakMemory();
+
+		void write(std::ostream &out, Format format) const;
+
+		static void countAllocations();
+		static size_t getAllocationCount();
+		static size_t getAllocatedBytes();
+
+	private:
+		struct Stage {
+			std::string name;
+			double milliseconds;
+			size_t allocations;
+			size_t bytes;
+		};
+		struct Counter {
+			std::string name;
+			std::string value;
+			std::string unit;
+			bool quoted;
+		};
+		struct Limit {
+			std::string directive;
+			std::string name;
+			size_t used;
+			size_t limit;
+		};
+
+		std::vector<Stage> _stages;
+		std::vector<Counter> _counters;
+		std::vector<Limit> _limits;
+
+		void writeText(std::ostream &out) const;
+		void writeJson(std::ostream &out) const;
+};
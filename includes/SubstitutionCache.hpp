@@ -0,0 +1,39 @@
+#pragma once
+
+#include "RegexParser.hpp"
+
+#include <string>
+#include <string_view>
+#include <map>
+#include <unordered_map>
+
+// Parses each {NAME} definition of a .l file at most once and hands out the
+// resulting sub-tree to every rule that references it.
+class SubstitutionCache {
+	public:
+		using NodeId = RegexParser::NodeId;
+
+		SubstitutionCache(const std::map<std::string_view, std::string_view> &substitutions, RegexArena &arena);
+		~SubstitutionCache();
+
+		NodeId resolve(const std::string &name);
+
+		size_t getHits() const;
+		size_t getMisses() const;
+
+	private:
+		enum EntryState {
+			IN_PROGRESS,
+			DONE
+		};
+		struct Entry {
+			EntryState state;
+			NodeId root;
+		};
+
+		const std::map<std::string_view, std::string_view> &_substitutions;
+		RegexArena &_arena;
+		std::unordered_map<std::string, Entry> _entries;
+		size_t _hits = 0;
+		size_t _misses = 0;
+};
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads, each with its own task deque. A worker pops
+// the newest task of its own deque and, once it is empty, steals the oldest
+// task of another one. Tasks receive the index of the worker running them so
+// that they can use per-worker state without locking.
+class ThreadPool {
+	public:
+		using Task = std::function<void(size_t worker)>;
+
+		explicit ThreadPool(size_t threadCount);
+		~ThreadPool();
+
+		// tasks are dealt round-robin over the worker deques
+		void submit(Task task);
+		// blocks until every submitted task has run
+		void wait();
+
+		size_t getThreadCount() const;
+		size_t getStealCount() const;
+
+	private:
+		struct Queue {
+			std::mutex mutex;
+			std::deque<Task> tasks;
+		};
+
+		std::vector<std::unique_ptr<Queue>> _queues;
+		std::vector<std::thread> _threads;
+
+		std::mutex _mutex;
+		std::condition_variable _wake;
+		std::condition_variable _idle;
+		size_t _queued = 0;
+		size_t _pending = 0;
+		size_t _nextQueue = 0;
+		bool _stopping = false;
+		std::atomic<size_t> _steals{ 0 };
+
+		bool popTask(size_t worker, Task &task);
+		void workerLoop(size_t worker);
+};
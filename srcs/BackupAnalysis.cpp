@@ -0,0 +1,221 @@
+#include "BackupAnalysis.hpp"
+
+#include <algorithm>
+#include <cctype>
+
+BackupAnalysis::BackupAnalysis() {}
+
+BackupAnalysis::~BackupAnalysis() {}
+
+// The byte shown for each class in examples: a letter or digit when the class
+// has one, then other printable bytes, then the rest.
+static std::vector<uint8_t> classExamples(const Dfa &dfa) {
+	std::vector<int> order;
+	for (int b = 'a'; b <= 'z'; ++b) {
+		order.push_back(b);
+	}
+	for (int b = 'A'; b <= 'Z'; ++b) {
+		order.push_back(b);
+	}
+	for (int b = '0'; b <= '9'; ++b) {
+		order.push_back(b);
+	}
+	for (int b = 0; b < 256; ++b) {
+		if (!std::isalnum(b) && b >= 0x20 && b < 0x7f) {
+			order.push_back(b);
+		}
+	}
+	for (int b = 0; b < 256; ++b) {
+		if (b < 0x20 || b >= 0x7f) {
+			order.push_back(b);
+		}
+	}
+	std::vector<uint8_t> examples(dfa.getClassCount(), 0);
+	std::vector<bool> found(dfa.getClassCount(), false);
+	for (int b : order) {
+		uint16_t c = dfa.getClass(static_cast<uint8_t>(b));
+		if (!found[c]) {
+			found[c] = true;
+			examples[c] = static_cast<uint8_t>(b);
+		}
+	}
+	return examples;
+}
+
+// A breadth-first search over (state, whether an accepting state was passed)
+// pairs from every start state, in start condition order, finds the
+// backing-up states and the shortest example of each at once. A start state
+// counts as accepting only when a transition comes back to it, as the
+// scanner never takes an empty match.
+void BackupAnalysis::analyze(const Dfa &dfa) {
+	_states.clear();
+	size_t nodeCount = dfa.getStateCount() * 2;
+	std::vector<uint32_t> parent(nodeCount, UINT32_MAX);
+	std::vector<uint8_t> via(nodeCount, 0);
+	std::vector<uint32_t> origin(nodeCount, 0);
+	std::vector<bool> seen(nodeCount, false);
+	std::vector<uint32_t> queue;
+	std::vector<uint8_t> examples = classExamples(dfa);
+
+	for (size_t c = 0; c < dfa.getStartStateCount(); ++c) {
+		for (bool atLineStart : { false, true }) {
+			uint32_t node = dfa.getStartState(c, atLineStart) * 2;
+			if (dfa.getStartState(c, atLineStart) != Dfa::DEAD_STATE && !seen[node]) {
+				seen[node] = true;
+				origin[node] = static_cast<uint32_t>(c * 2 + atLineStart);
+				queue.push_back(node);
+			}
+		}
+	}
+	for (size_t i = 0; i < queue.size(); ++i) {
+		uint32_t node = queue[i];
+		Dfa::StateId state = node / 2;
+		for (uint16_t k = 0; k < dfa.getClassCount(); ++k) {
+			Dfa::StateId target = dfa.getTransition(state, k);
+			if (target == Dfa::DEAD_STATE) {
+				continue;
+			}
+			uint32_t next = target * 2 + ((node & 1) || dfa.getAcceptRule(target) != Dfa::NO_RULE);
+			if (!seen[next]) {
+				seen[next] = true;
+				parent[next] = node;
+				via[next] = examples[k];
+				origin[next] = origin[node];
+				queue.push_back(next);
+			}
+		}
+	}
+
+	for (Dfa::StateId s = 1; s < dfa.getStateCount(); ++s) {
+		uint32_t node = s * 2 + 1;
+		if (dfa.getAcceptRule(s) != Dfa::NO_RULE || !seen[node]) {
+			continue;
+		}
+		std::vector<uint32_t> path;
+		for (uint32_t n = node; n != UINT32_MAX; n = parent[n]) {
+			path.push_back(n);
+		}
+		std::reverse(path.begin(), path.end());
+		State found = { s, origin[node] / 2, (origin[node] & 1) != 0, "", 0, Dfa::NO_RULE };
+		for (size_t i = 1; i < path.size(); ++i) {
+			found.example += static_cast<char>(via[path[i]]);
+			int32_t rule = dfa.getAcceptRule(path[i] / 2);
+			if (rule != Dfa::NO_RULE) {
+				found.backupLength = i;
+				found.backupRule = rule;
+			}
+		}
+		_states.push_back(std::move(found));
+	}
+}
+
+const std::vector<BackupAnalysis::State> &BackupAnalysis::getStates() const {
+	return _states;
+}
+
+bool BackupAnalysis::empty() const {
+	return _states.empty();
+}
+
+static std::string printable(uint8_t byte) {
+	switch (byte) {
+		case '\n':
+			return "\\n";
+		case '\t':
+			return "\\t";
+		case '\\':
+			return "\\\\";
+		case '"':
+			return "\\\"";
+		default:
+			break;
+	}
+	if (byte > 0x20 && byte < 0x7f) {
+		return std::string(1, static_cast<char>(byte));
+	}
+	std::string octal = "\\";
+	octal += static_cast<char>('0' + (byte >> 6));
+	octal += static_cast<char>('0' + ((byte >> 3) & 7));
+	octal += static_cast<char>('0' + (byte & 7));
+	return octal;
+}
+
+std::string BackupAnalysis::quote(std::string_view text) {
+	std::string out = "\"";
+	for (char ch : text) {
+		out += ch == ' ' ? std::string(" ") : printable(static_cast<uint8_t>(ch));
+	}
+	return out + "\"";
+}
+
+// the bytes of the state whose transition is (or is not) dead, as ranges
+static std::string byteRanges(const Dfa &dfa, Dfa::StateId state, bool dead) {
+	std::string out;
+	int b = 0;
+	while (b < 256) {
+		if ((dfa.getTransition(state, dfa.getClass(static_cast<uint8_t>(b))) == Dfa::DEAD_STATE) != dead) {
+			++b;
+			continue;
+		}
+		int lo = b;
+		while (b < 256 && (dfa.getTransition(state, dfa.getClass(static_cast<uint8_t>(b))) == Dfa::DEAD_STATE) == dead) {
+			++b;
+		}
+		out += " " + printable(static_cast<uint8_t>(lo));
+		if (b - 1 > lo) {
+			out += "-" + printable(static_cast<uint8_t>(b - 1));
+		}
+	}
+	return out;
+}
+
+void BackupAnalysis::writeReport(std::ostream &out, const Dfa &dfa, const LexFileParser::Content &content) const {
+	std::vector<uint32_t> marks(dfa.getStateCount(), 0);
+	uint32_t generation = 0;
+	std::vector<Dfa::StateId> reached;
+	for (const State &state : _states) {
+		// the rules still reachable from the state
+		++generation;
+		reached.assign(1, state.state);
+		marks[state.state] = generation;
+		std::vector<size_t> lines;
+		for (size_t i = 0; i < reached.size(); ++i) {
+			int32_t rule = dfa.getAcceptRule(reached[i]);
+			if (rule != Dfa::NO_RULE) {
+				lines.push_back(content.rules[rule].line);
+			}
+			for (uint16_t k = 0; k < dfa.getClassCount(); ++k) {
+				Dfa::StateId target = dfa.getTransition(reached[i], k);
+				if (target != Dfa::DEAD_STATE && marks[target] != generation) {
+					marks[target] = generation;
+					reached.push_back(target);
+				}
+			}
+		}
+		std::sort(lines.begin(), lines.end());
+		lines.erase(std::unique(lines.begin(), lines.end()), lines.end());
+
+		out << "State #" << state.state << " is non-accepting -\n";
+		out << " associated rule line numbers:";
+		for (size_t i = 0; i < lines.size(); ++i) {
+			out << (i % 8 == 0 ? "\n\t" : "\t") << lines[i];
+		}
+		out << "\n";
+		out << " example: ";
+		if (state.condition != 0) {
+			out << "<" << content.startConditions[state.condition].name << ">";
+		}
+		if (state.atLineStart) {
+			out << "^";
+		}
+		out << quote(state.example) << " backs up to " << quote(std::string_view(state.example).substr(0, state.backupLength))
+			<< ", matched by the rule at line " << content.rules[state.backupRule].line << "\n";
+		out << " out-transitions: [" << byteRanges(dfa, state.state, false) << " ]\n";
+		out << " jam-transitions: EOF [" << byteRanges(dfa, state.state, true) << " ]\n\n";
+	}
+	if (_states.empty()) {
+		out << "No backing up.\n";
+	} else {
+		out << _states.size() << " backing up (non-accepting) states.\n";
+	}
+}
@@ -0,0 +1,30 @@
+#include "CharSet.hpp"
+
+CharSetTable::CharSetTable() {}
+
+CharSetTable::~CharSetTable() {}
+
+CharSetTable::SetId CharSetTable::intern(const CharSet &set) {
+	auto [it, inserted] = _ids.try_emplace(set, static_cast<SetId>(_sets.size()));
+	if (inserted) {
+		_sets.push_back(set);
+	}
+	return it->second;
+}
+
+const CharSet &CharSetTable::get(SetId id) const {
+	return _sets[id];
+}
+
+size_t CharSetTable::size() const {
+	return _sets.size();
+}
+
+size_t CharSetTable::bytesUsed() const {
+	return _sets.capacity() * sizeof(CharSet) + _ids.size() * (sizeof(CharSet) + sizeof(SetId) + 2 * sizeof(void *));
+}
+
+void CharSetTable::clear() {
+	_sets.clear();
+	_ids.clear();
+}
@@ -1,6 +1,8 @@
 #include "CliArguments.hpp"
 
+#include <algorithm>
 #include <iostream>
+#include <thread>
 
 CliArguments::CliArguments(int argc, char **argv) {
 	_argc = argc;
@@ -16,7 +18,105 @@ bool CliArguments::parse() {
 	if (_argc < 2) {
 		return false;
 	}
-	_inputFile = _argv[1];
+	for (int i = 1; i < _argc; ++i) {
+		const std::string &arg = _argv[i];
+		if (arg == "--stats" || arg == "--stats=text") {
+			_stats = true;
+			_statsFormat = Stats::TEXT;
+		} else if (arg == "--stats=json") {
+			_stats = true;
+			_statsFormat = Stats::JSON;
+		} else if (arg == "--ast") {
+			_printAst = true;
+		} else if (arg == "-t" || arg == "--stdout") {
+			_outputFile = "-";
+		} else if (arg == "-o") {
+			if (i + 1 >= _argc) {
+				return false;
+			}
+			_outputFile = _argv[++i];
+		} else if (arg == "--no-simd") {
+			_skipLoops = false;
+		} else if (arg == "--no-optimize") {
+			_optimize = false;
+		} else if (arg == "--no-keywords") {
+			_keywordTable = false;
+		} else if (arg == "-b") {
+			_backupReport = true;
+		} else if (arg == "--no-backup") {
+			_backingUp = false;
+		} else if (arg == "--direct") {
+			_styleSet = true;
+			_scannerStyle = LexFileParser::Content::DIRECT_CODED;
+		} else if (arg == "--tables=full") {
+			_tableMode = CodeGenerator::FULL;
+			_styleSet = true;
+			_scannerStyle = LexFileParser::Content::TABLE_DRIVEN;
+		} else if (arg == "--tables=compressed") {
+			_tableMode = CodeGenerator::COMPRESSED;
+			_styleSet = true;
+			_scannerStyle = LexFileParser::Content::TABLE_DRIVEN;
+		} else if (arg == "-R" || arg == "--reentrant") {
+			_reentrant = true;
+		} else if (arg == "--run") {
+			_run = true;
+		} else if (arg == "--count") {
+			_run = true;
+			_countOnly = true;
+		} else if (arg.starts_with("--cache-size=")) {
+			std::string value = arg.substr(13);
+			if (value.empty() || value.size() > 12 || value.find_first_not_of("0123456789") != std::string::npos) {
+				std::cerr << "Invalid cache size: " << value << std::endl;
+				return false;
+			}
+			_cacheSize = std::max<size_t>(std::stoul(value), MIN_CACHE_SIZE);
+		} else if (arg.starts_with("--threads=")) {
+			std::string value = arg.substr(10);
+			if (value.empty() || value.size() > 4 || value.find_first_not_of("0123456789") != std::string::npos) {
+				std::cerr << "Invalid thread count: " << value << std::endl;
+				return false;
+			}
+			_threads = std::stoul(value);
+			if (_threads == 0) {
+				_threads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+			}
+		} else if (arg.starts_with("--dfa-states=")) {
+			std::string value = arg.substr(13);
+			if (value.empty() || value.size() > 9 || value.find_first_not_of("0123456789") != std::string::npos) {
+				std::cerr << "Invalid DFA state budget: " << value << std::endl;
+				return false;
+			}
+			_dfaStates = std::max<size_t>(std::stoul(value), MIN_DFA_STATES);
+		} else if (arg.starts_with("--dfa-memory=")) {
+			std::string value = arg.substr(13);
+			if (value.empty() || value.size() > 12 || value.find_first_not_of("0123456789") != std::string::npos) {
+				std::cerr << "Invalid DFA memory budget: " << value << std::endl;
+				return false;
+			}
+			_dfaMemory = std::max<size_t>(std::stoul(value), MIN_DFA_MEMORY);
+		} else if (arg.starts_with("--compile-cache=")) {
+			_compileCache = arg.substr(16);
+			if (_compileCache.empty()) {
+				std::cerr << "Invalid compile cache directory" << std::endl;
+				return false;
+			}
+		} else if (arg == "--clear-compile-cache") {
+			_clearCompileCache = true;
+		} else if (arg == "--engine=auto") {
+			_engine = Interpreter::AUTO;
+		} else if (arg == "--engine=dfa") {
+			_engine = Interpreter::LAZY_DFA;
+		} else if (arg == "--engine=glushkov") {
+			_engine = Interpreter::GLUSHKOV;
+		} else if (arg.length() > 1 && arg[0] == '-') {
+			std::cerr << "Unknown option: " << arg << std::endl;
+			return false;
+		} else if (_inputFile.empty()) {
+			_inputFile = arg;
+		} else {
+			return false;
+		}
+	}
 	if (_inputFile.length() < 3 || _inputFile.substr(_inputFile.length() - 2) != ".l") {
 		return false;
 	}
@@ -27,6 +127,125 @@ std::string CliArguments::getInputFile() const {
 	return _inputFile;
 }
 
+bool CliArguments::isStatsEnabled() const {
+	return _stats;
+}
+
+Stats::Format CliArguments::getStatsFormat() const {
+	return _statsFormat;
+}
+
+bool CliArguments::isAstPrintEnabled() const {
+	return _printAst;
+}
+
+std::string CliArguments::getOutputFile() const {
+	return _outputFile;
+}
+
+CodeGenerator::TableMode CliArguments::getTableMode() const {
+	return _tableMode;
+}
+
+bool CliArguments::areSkipLoopsEnabled() const {
+	return _skipLoops;
+}
+
+bool CliArguments::isOptimizationEnabled() const {
+	return _optimize;
+}
+
+bool CliArguments::isKeywordTableEnabled() const {
+	return _keywordTable;
+}
+
+bool CliArguments::isBackupReportEnabled() const {
+	return _backupReport;
+}
+
+bool CliArguments::isBackingUpAllowed() const {
+	return _backingUp;
+}
+
+// a style given on the command line overrides the %option of the .l file
+LexFileParser::Content::ScannerStyle CliArguments::getScannerStyle(LexFileParser::Content::ScannerStyle fileStyle) const {
+	return _styleSet ? _scannerStyle : fileStyle;
+}
+
+// -R asks for a reentrant scanner even without %option reentrant
+bool CliArguments::isReentrant(bool fileReentrant) const {
+	return _reentrant || fileReentrant;
+}
+
+bool CliArguments::isRunEnabled() const {
+	return _run;
+}
+
+bool CliArguments::isCountOnly() const {
+	return _countOnly;
+}
+
+size_t CliArguments::getCacheSize() const {
+	return _cacheSize;
+}
+
+size_t CliArguments::getThreadCount() const {
+	return _threads;
+}
+
+Interpreter::EngineChoice CliArguments::getEngine() const {
+	return _engine;
+}
+
+size_t CliArguments::getDfaStateBudget() const {
+	return _dfaStates;
+}
+
+size_t CliArguments::getDfaMemoryBudget() const {
+	return _dfaMemory;
+}
+
+std::string CliArguments::getCompileCacheDirectory() const {
+	return _compileCache;
+}
+
+bool CliArguments::isCompileCacheCleared() const {
+	return _clearCompileCache;
+}
+
+std::string CliArguments::getAutomatonOptions() const {
+	return "optimize=" + std::to_string(_optimize) + " keywords=" + std::to_string(_keywordTable)
+		+ " dfa-states=" + std::to_string(_dfaStates) + " dfa-memory=" + std::to_string(_dfaMemory);
+}
+
 void CliArguments::printUsage() const {
-	std::cout << "Usage: " << _argv[0] << " <input_file.l>" << std::endl;
-}
\ No newline at end of file
+	std::cout << "Usage: " << _argv[0] << " [options] <input_file.l>" << std::endl;
+	std::cout << "Options:" << std::endl;
+	std::cout << "  -o <file>                   write the scanner to <file> (default lex.yy.c)" << std::endl;
+	std::cout << "  -t, --stdout                write the scanner to the standard output" << std::endl;
+	std::cout << "  --tables=full|compressed    transition table layout (default compressed)" << std::endl;
+	std::cout << "  --direct                    emit a direct-coded (goto) scanner" << std::endl;
+	std::cout << "  -R, --reentrant             emit a reentrant scanner: yylex(yyscan_t), with its state in a" << std::endl;
+	std::cout << "                              scanner object instead of globals" << std::endl;
+	std::cout << "  --no-simd                   do not emit SIMD skip loops for self-looping states" << std::endl;
+	std::cout << "  --no-optimize               lower the patterns as parsed, without rewriting them first" << std::endl;
+	std::cout << "  --no-keywords               keep keyword rules in the DFA instead of looking them up in the" << std::endl;
+	std::cout << "                              lexemes of the identifier rule that matches them" << std::endl;
+	std::cout << "  -b                          write the DFA states that back up, with examples, to lex.backup" << std::endl;
+	std::cout << "  --no-backup                 fail when the scanner would have to back up" << std::endl;
+	std::cout << "  --dfa-states=<n>            DFA state budget; rules that exceed it are matched by NFA" << std::endl;
+	std::cout << "                              simulation in the scanner (default 65536)" << std::endl;
+	std::cout << "  --dfa-memory=<bytes>        DFA construction memory budget (default 128 MiB)" << std::endl;
+	std::cout << "  --compile-cache=<dir>       keep the automata in <dir>, keyed by the rules and flags, and reuse" << std::endl;
+	std::cout << "                              them while only actions and code change" << std::endl;
+	std::cout << "  --clear-compile-cache       remove the entries of the --compile-cache directory first" << std::endl;
+	std::cout << "  --run                       tokenize the standard input, print each rule and lexeme" << std::endl;
+	std::cout << "  --count                     like --run, but only print how many tokens each rule matched" << std::endl;
+	std::cout << "  --cache-size=<bytes>        memory budget of the lazy DFA used by --run (default 8 MiB)" << std::endl;
+	std::cout << "  --threads=<n>               split --run input into chunks scanned by n threads (0: one per core)" << std::endl;
+	std::cout << "  --engine=auto|dfa|glushkov  matcher used by --run; auto picks the bit-parallel Glushkov" << std::endl;
+	std::cout << "                              automaton when the rules fit in 128 positions (default auto)" << std::endl;
+	std::cout << "  --ast                       print the regex tree of every rule" << std::endl;
+	std::cout << "  --stats[=text|json]         print the time and allocations of each stage, automaton sizes and" << std::endl;
+	std::cout << "                              the use of the % directive limits to the standard error" << std::endl;
+}
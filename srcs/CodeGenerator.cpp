@@ -0,0 +1,1772 @@
+#include "CodeGenerator.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+
+constexpr static size_t TEMPLATE_WINDOW = 32;
+// past this size a direct-coded scanner costs more in i-cache than it saves
+constexpr static size_t MAX_DIRECT_CODE_BYTES = 4 * 1024 * 1024;
+constexpr static size_t MAX_SKIP_RANGES = 4;
+constexpr static size_t MIN_SKIP_BYTES = 8;
+
+CodeGenerator::CodeGenerator(const LexFileParser::Content &content, const Dfa &dfa, const Nfa &nfa)
+	: _content(content), _dfa(dfa), _nfa(nfa) {
+	packTables();
+	findSkipLoops();
+	_backup.analyze(_dfa);
+}
+
+CodeGenerator::~CodeGenerator() {}
+
+static const char *intType(long maxValue, long minValue = 0) {
+	if (minValue >= -128 && maxValue <= 127) {
+		return "signed char";
+	}
+	if (minValue >= -32768 && maxValue <= 32767) {
+		return "short";
+	}
+	return "int";
+}
+
+static size_t intSize(long maxValue, long minValue = 0) {
+	if (minValue >= -128 && maxValue <= 127) {
+		return 1;
+	}
+	if (minValue >= -32768 && maxValue <= 32767) {
+		return 2;
+	}
+	return 4;
+}
+
+template <typename T>
+static void emitArray(std::ostream &out, const char *type, const std::string &name, const std::vector<T> &values) {
+	out << "static const " << type << " " << name << "[" << values.size() << "] = {";
+	for (size_t i = 0; i < values.size(); ++i) {
+		if (i % 16 == 0) {
+			out << "\n\t";
+		}
+		out << values[i];
+		if (i + 1 < values.size()) {
+			out << ", ";
+		}
+	}
+	out << "\n};\n\n";
+}
+
+// Row-displacement packing: each state picks, among the recent states, the
+// one whose row it differs least from as its default, stores only the
+// differing entries, and gets the lowest base where those entries land on
+// free slots of yy_nxt/yy_chk.
+void CodeGenerator::packTables() {
+	size_t stateCount = _dfa.getStateCount();
+	size_t classCount = _dfa.getClassCount();
+	// the end-of-buffer column is dead everywhere and never stored, but every
+	// row still has to be addressable through it
+	size_t columnCount = classCount + 1;
+	_base.assign(stateCount, 0);
+	_default.assign(stateCount, -1);
+	_next.clear();
+	_check.clear();
+	_packedEntries = 0;
+
+	// nextFree[i] leads, through path-compressed links, to the first free
+	// slot at or after i, so dense regions of the comb are skipped in O(1)
+	std::vector<size_t> nextFree;
+	auto findFree = [&nextFree](size_t slot) {
+		size_t root = slot;
+		while (root < nextFree.size() && nextFree[root] != root) {
+			root = nextFree[root];
+		}
+		while (slot < nextFree.size() && nextFree[slot] != slot) {
+			size_t following = nextFree[slot];
+			nextFree[slot] = root;
+			slot = following;
+		}
+		return root;
+	};
+	std::vector<size_t> entries;
+	for (size_t s = 1; s < stateCount; ++s) {
+		size_t bestCost = 0;
+		for (size_t c = 0; c < classCount; ++c) {
+			if (_dfa.getTransition(s, c) != Dfa::DEAD_STATE) {
+				++bestCost;
+			}
+		}
+		int bestTemplate = -1;
+		for (size_t t = (s > TEMPLATE_WINDOW ? s - TEMPLATE_WINDOW : 1); t < s; ++t) {
+			size_t cost = 0;
+			for (size_t c = 0; c < classCount && cost < bestCost; ++c) {
+				if (_dfa.getTransition(s, c) != _dfa.getTransition(t, c)) {
+					++cost;
+				}
+			}
+			if (cost < bestCost) {
+				bestCost = cost;
+				bestTemplate = static_cast<int>(t);
+			}
+		}
+		_default[s] = bestTemplate;
+
+		entries.clear();
+		for (size_t c = 0; c < classCount; ++c) {
+			Dfa::StateId fallback = bestTemplate < 0 ? Dfa::DEAD_STATE : _dfa.getTransition(bestTemplate, c);
+			if (_dfa.getTransition(s, c) != fallback) {
+				entries.push_back(c);
+			}
+		}
+		if (entries.empty()) {
+			continue;
+		}
+
+		size_t slot = findFree(entries[0]);
+		size_t base = slot - entries[0];
+		while (true) {
+			bool fits = true;
+			for (size_t c : entries) {
+				if (findFree(base + c) != base + c) {
+					fits = false;
+					break;
+				}
+			}
+			if (fits) {
+				break;
+			}
+			slot = findFree(slot + 1);
+			base = slot - entries[0];
+		}
+		if (nextFree.size() < base + columnCount) {
+			size_t oldSize = nextFree.size();
+			nextFree.resize(base + columnCount);
+			for (size_t i = oldSize; i < nextFree.size(); ++i) {
+				nextFree[i] = i;
+			}
+			_next.resize(base + columnCount, 0);
+			_check.resize(base + columnCount, -1);
+		}
+		for (size_t c : entries) {
+			nextFree[base + c] = base + c + 1;
+			_next[base + c] = static_cast<int>(_dfa.getTransition(s, c));
+			_check[base + c] = static_cast<int>(s);
+		}
+		_base[s] = static_cast<int>(base);
+		_packedEntries += entries.size();
+	}
+	if (_next.size() < columnCount) {
+		_next.resize(columnCount, 0);
+		_check.resize(columnCount, -1);
+	}
+}
+
+static std::vector<std::pair<uint8_t, uint8_t>> toRanges(const std::vector<bool> &members) {
+	std::vector<std::pair<uint8_t, uint8_t>> ranges;
+	int b = 0;
+	while (b < 256) {
+		if (!members[b]) {
+			++b;
+			continue;
+		}
+		int lo = b;
+		while (b < 256 && members[b]) {
+			++b;
+		}
+		ranges.push_back({ static_cast<uint8_t>(lo), static_cast<uint8_t>(b - 1) });
+	}
+	return ranges;
+}
+
+// A state qualifies when at least half of the bytes that keep the scan alive
+// loop back to it and the loop set, or its complement, is a handful of
+// ranges that a SIMD compare can test 16 or 32 bytes at a time.
+void CodeGenerator::findSkipLoops() {
+	_skipLoops.clear();
+	_skipIndex.assign(_dfa.getStateCount(), -1);
+	std::vector<bool> loop(256);
+	std::vector<bool> exits(256);
+	// the candidates are screened per class, most states have no self-loop
+	std::vector<size_t> classBytes(_dfa.getClassCount(), 0);
+	for (int b = 0; b < 256; ++b) {
+		++classBytes[_dfa.getClass(static_cast<uint8_t>(b))];
+	}
+	for (size_t s = 1; s < _dfa.getStateCount(); ++s) {
+		size_t loopBytes = 0;
+		size_t liveBytes = 0;
+		for (size_t c = 0; c < _dfa.getClassCount(); ++c) {
+			Dfa::StateId target = _dfa.getTransition(s, static_cast<uint16_t>(c));
+			loopBytes += (target == s) ? classBytes[c] : 0;
+			liveBytes += (target != Dfa::DEAD_STATE) ? classBytes[c] : 0;
+		}
+		if (loopBytes < MIN_SKIP_BYTES || loopBytes * 2 < liveBytes) {
+			continue;
+		}
+		for (int b = 0; b < 256; ++b) {
+			loop[b] = (_dfa.getTransition(s, _dfa.getClass(static_cast<uint8_t>(b))) == s);
+			exits[b] = !loop[b];
+		}
+		SkipLoop skip{ static_cast<Dfa::StateId>(s), false, toRanges(loop) };
+		auto complement = toRanges(exits);
+		if (complement.size() < skip.ranges.size()) {
+			skip.negate = true;
+			skip.ranges = complement;
+		}
+		if (skip.ranges.size() > MAX_SKIP_RANGES) {
+			continue;
+		}
+		_skipIndex[s] = static_cast<int>(_skipLoops.size());
+		_skipLoops.push_back(skip);
+	}
+}
+
+bool CodeGenerator::hasSkipLoops() const {
+	return _skipLoopsEnabled && !_skipLoops.empty();
+}
+
+bool CodeGenerator::hasKeywords() const {
+	return _keywords != nullptr && !_keywords->empty();
+}
+
+std::vector<std::pair<size_t, bool>> CodeGenerator::startEntries() const {
+	std::vector<std::pair<size_t, bool>> entries;
+	for (size_t c = 0; c < _content.startConditions.size(); ++c) {
+		entries.push_back({ c, false });
+		if (_nfa.hasLineStartRules()) {
+			entries.push_back({ c, true });
+		}
+	}
+	return entries;
+}
+
+std::vector<Nfa::StateId> CodeGenerator::fallbackStates() const {
+	const std::vector<bool> &fallback = _dfa.getFallbackRules();
+	std::vector<Nfa::StateId> states;
+	for (size_t r = 0; r < fallback.size(); ++r) {
+		if (fallback[r]) {
+			auto [first, last] = _nfa.getRuleStates(r);
+			for (Nfa::StateId s = first; s < last; ++s) {
+				states.push_back(s);
+			}
+		}
+	}
+	auto [sharedFirst, sharedLast] = _nfa.getSharedStates();
+	for (Nfa::StateId s = sharedFirst; s < sharedLast; ++s) {
+		states.push_back(s);
+	}
+	return states;
+}
+
+std::string CodeGenerator::startIndex() const {
+	return _nfa.hasLineStartRules() ? "yy_start * 2 + yy_at_bol" : "yy_start";
+}
+
+void CodeGenerator::setKeywordTable(const KeywordTable &keywords) {
+	_keywords = &keywords;
+}
+
+void CodeGenerator::setReentrant(bool reentrant) {
+	_reentrant = reentrant;
+}
+
+const BackupAnalysis &CodeGenerator::getBackupAnalysis() const {
+	return _backup;
+}
+
+size_t CodeGenerator::getSkipLoopCount() const {
+	return _skipLoops.size();
+}
+
+void CodeGenerator::setSkipLoopsEnabled(bool enabled) {
+	_skipLoopsEnabled = enabled;
+}
+
+size_t CodeGenerator::getFullTableBytes() const {
+	return _dfa.getStateCount() * (_dfa.getClassCount() + 1) * intSize(static_cast<long>(_dfa.getStateCount()));
+}
+
+size_t CodeGenerator::getCompressedTableBytes() const {
+	long states = static_cast<long>(_dfa.getStateCount());
+	long slots = static_cast<long>(_next.size());
+	return _base.size() * intSize(slots) + _default.size() * intSize(states, -1)
+		+ _next.size() * intSize(states) + _check.size() * intSize(states, -1);
+}
+
+size_t CodeGenerator::getTableTransitionCount(TableMode mode) const {
+	if (mode == COMPRESSED) {
+		return _packedEntries;
+	}
+	size_t transitions = 0;
+	for (size_t s = 0; s < _dfa.getStateCount(); ++s) {
+		for (size_t c = 0; c < _dfa.getClassCount(); ++c) {
+			if (_dfa.getTransition(s, c) != Dfa::DEAD_STATE) {
+				++transitions;
+			}
+		}
+	}
+	return transitions;
+}
+
+size_t CodeGenerator::getTableEntryCount(TableMode mode) const {
+	return mode == FULL ? _dfa.getStateCount() * (_dfa.getClassCount() + 1) : _next.size();
+}
+
+bool CodeGenerator::checkCapacity(TableMode mode) const {
+	size_t transitions = getTableTransitionCount(mode);
+	size_t outputSize = getTableEntryCount(mode);
+	bool valid = true;
+	if (transitions > _content.transitionsSize) {
+		std::cerr << "Error: " << transitions << " table transitions exceed the %a limit of " << _content.transitionsSize << std::endl;
+		valid = false;
+	}
+	if (outputSize > _content.outputArraySize) {
+		std::cerr << "Error: transition table of " << outputSize << " entries exceeds the %o limit of " << _content.outputArraySize << std::endl;
+		valid = false;
+	}
+	return valid;
+}
+
+void CodeGenerator::emitPrologue(std::ostream &out) const {
+	out << "/* A lexical scanner generated by ft_lex */\n\n";
+	out << "#include <stdio.h>\n";
+	out << "#include <stdlib.h>\n";
+	out << "#include <string.h>\n\n";
+	for (const auto &line : _content.definitionCode) {
+		out << line << "\n";
+	}
+	out << "\n";
+	for (size_t c = 0; c < _content.startConditions.size(); ++c) {
+		out << "#define " << _content.startConditions[c].name << " " << c << "\n";
+	}
+	out << "\n";
+	out << "#define BEGIN yy_start = \n";
+	out << "#define YY_START yy_start\n";
+	out << "#define ECHO fwrite(yytext, (size_t)yyleng, 1, yyout)\n";
+	out << "#define yyterminate() return 0\n";
+	out << "#define YY_BREAK break;\n";
+	out << "#define YY_NUM_RULES " << _content.rules.size() << "\n";
+	out << "#ifndef YY_BUF_SIZE\n#define YY_BUF_SIZE " << _content.bufferSize << "\n#endif\n";
+	out << "#ifndef YY_MMAP_MIN\n#define YY_MMAP_MIN 65536\n#endif\n";
+	// %array scanners never write to their buffer and map the input read-only;
+	// %pointer scanners terminate yytext in place, which would copy every page
+	// of a private mapping, so they read into the buffer unless asked to map
+	if (_content.yytextType == LexFileParser::Content::ARRAY) {
+		out << "#if (defined(__unix__) || defined(__APPLE__)) && !defined(YY_NO_MMAP)\n";
+		out << "#define YY_USE_MMAP\n#define YY_MMAP_PROT PROT_READ\n#endif\n";
+	} else {
+		out << "#if (defined(__unix__) || defined(__APPLE__)) && defined(YY_MMAP)\n";
+		out << "#define YY_USE_MMAP\n#define YY_MMAP_PROT (PROT_READ | PROT_WRITE)\n#endif\n";
+	}
+	if (_content.yytextType == LexFileParser::Content::ARRAY) {
+		out << "#ifndef YYLMAX\n#define YYLMAX 8192\n#endif\n";
+	}
+	emitScannerState(out);
+}
+
+// The state of the scanner: globals, or the members of struct yyguts_t with
+// macros that spell them as the globals. The helpers that touch it are
+// declared with YY_ONLY_ARG/YY_LAST_ARG, start with YY_DECL_GUTS and are
+// called with YY_CALL_ONLY_ARG/YY_CALL_LAST_ARG, which all expand to nothing
+// in a scanner on globals.
+void CodeGenerator::emitScannerState(std::ostream &out) const {
+	bool array = _content.yytextType == LexFileParser::Content::ARRAY;
+	bool fallback = _dfa.getFallbackCount() > 0;
+	if (fallback) {
+		out << "#define YY_NFA_STATES " << fallbackStates().size() << "\n";
+	}
+	out << "\n";
+	if (!_reentrant) {
+		out << "#define YY_ONLY_ARG void\n";
+		out << "#define YY_LAST_ARG\n";
+		out << "#define YY_CALL_ONLY_ARG\n";
+		out << "#define YY_CALL_LAST_ARG\n";
+		out << "#define YY_DECL_GUTS\n\n";
+		out << "FILE *yyin = NULL;\n";
+		out << "FILE *yyout = NULL;\n";
+		out << (array ? "char yytext[YYLMAX];\n" : "char *yytext = NULL;\n");
+		out << "int yyleng = 0;\n";
+		out << "static int yy_start = INITIAL;\n";
+		if (_nfa.hasLineStartRules()) {
+			out << "static int yy_at_bol = 1;\n";
+		}
+		out << R"(static char *yy_buf = NULL;
+static size_t yy_buf_cap = 0;
+static size_t yy_buf_len = 0;
+static size_t yy_cp = 0;
+static char yy_hold_char = '\0';
+static int yy_eof_seen = 0;
+static int yy_mapped = 0;
+static int yy_map_tried = 0;
+)";
+		if (fallback) {
+			out << R"(static int yy_nfa_sets[2][YY_NFA_STATES];
+static int yy_nfa_stack[YY_NFA_STATES];
+static unsigned yy_nfa_mark[YY_NFA_STATES];
+static unsigned yy_nfa_gen = 0;
+)";
+		}
+		if (_nfa.hasLineStartRules()) {
+			out << "#define YY_AT_BOL() (yy_at_bol)\n";
+			out << "#define yy_set_bol(at_bol) (yy_at_bol = (at_bol))\n";
+		}
+		out << "\n";
+		out << "int yylex(void);\n";
+		out << "int yywrap(void);\n";
+		out << "int yy_scan_bytes(const char *bytes, size_t len);\n";
+		out << "int yy_scan_string(const char *str);\n\n";
+		return;
+	}
+
+	out << "#ifndef YY_EXTRA_TYPE\n#define YY_EXTRA_TYPE void *\n#endif\n\n";
+	out << "typedef void *yyscan_t;\n\n";
+	out << "struct yyguts_t {\n";
+	out << "\tFILE *yyin_r;\n";
+	out << "\tFILE *yyout_r;\n";
+	out << (array ? "\tchar yytext_r[YYLMAX];\n" : "\tchar *yytext_r;\n");
+	out << "\tint yyleng_r;\n";
+	out << "\tYY_EXTRA_TYPE yyextra_r;\n";
+	out << "\tint yy_start;\n";
+	if (_nfa.hasLineStartRules()) {
+		out << "\tint yy_at_bol;\n";
+	}
+	out << R"(	char *yy_buf;
+	size_t yy_buf_cap;
+	size_t yy_buf_len;
+	size_t yy_cp;
+	char yy_hold_char;
+	int yy_eof_seen;
+	int yy_mapped;
+	int yy_map_tried;
+)";
+	if (fallback) {
+		out << R"(	int yy_nfa_sets[2][YY_NFA_STATES];
+	int yy_nfa_stack[YY_NFA_STATES];
+	unsigned yy_nfa_mark[YY_NFA_STATES];
+	unsigned yy_nfa_gen;
+)";
+	}
+	out << "};\n\n";
+	out << R"(#define YY_ONLY_ARG yyscan_t yyscanner
+#define YY_LAST_ARG , yyscan_t yyscanner
+#define YY_CALL_ONLY_ARG yyscanner
+#define YY_CALL_LAST_ARG , yyscanner
+#define YY_DECL_GUTS struct yyguts_t *yyg = (struct yyguts_t *)yyscanner;
+
+#define yyin (yyg->yyin_r)
+#define yyout (yyg->yyout_r)
+#define yytext (yyg->yytext_r)
+#define yyleng (yyg->yyleng_r)
+#define yyextra (yyg->yyextra_r)
+#define yy_start (yyg->yy_start)
+#define yy_buf (yyg->yy_buf)
+#define yy_buf_cap (yyg->yy_buf_cap)
+#define yy_buf_len (yyg->yy_buf_len)
+#define yy_cp (yyg->yy_cp)
+#define yy_hold_char (yyg->yy_hold_char)
+#define yy_eof_seen (yyg->yy_eof_seen)
+#define yy_mapped (yyg->yy_mapped)
+#define yy_map_tried (yyg->yy_map_tried)
+)";
+	if (_nfa.hasLineStartRules()) {
+		out << "#define yy_at_bol (yyg->yy_at_bol)\n";
+		out << "#define YY_AT_BOL() (yy_at_bol)\n";
+		out << "#define yy_set_bol(at_bol) (yy_at_bol = (at_bol))\n";
+	}
+	if (fallback) {
+		out << R"(#define yy_nfa_sets (yyg->yy_nfa_sets)
+#define yy_nfa_stack (yyg->yy_nfa_stack)
+#define yy_nfa_mark (yyg->yy_nfa_mark)
+#define yy_nfa_gen (yyg->yy_nfa_gen)
+)";
+	}
+	out << R"(
+int yylex_init(yyscan_t *scanner);
+int yylex_init_extra(YY_EXTRA_TYPE extra, yyscan_t *scanner);
+int yylex_destroy(yyscan_t yyscanner);
+int yylex(yyscan_t yyscanner);
+int yywrap(yyscan_t yyscanner);
+FILE *yyget_in(yyscan_t yyscanner);
+void yyset_in(FILE *in, yyscan_t yyscanner);
+FILE *yyget_out(yyscan_t yyscanner);
+void yyset_out(FILE *out, yyscan_t yyscanner);
+char *yyget_text(yyscan_t yyscanner);
+int yyget_leng(yyscan_t yyscanner);
+YY_EXTRA_TYPE yyget_extra(yyscan_t yyscanner);
+void yyset_extra(YY_EXTRA_TYPE extra, yyscan_t yyscanner);
+int yy_scan_bytes(const char *bytes, size_t len, yyscan_t yyscanner);
+int yy_scan_string(const char *str, yyscan_t yyscanner);
+
+)";
+}
+
+void CodeGenerator::emitTables(std::ostream &out, TableMode mode) const {
+	size_t stateCount = _dfa.getStateCount();
+	size_t classCount = _dfa.getClassCount();
+
+	// byte 0 reads as the end-of-buffer class, dead in every state, so that
+	// the sentinel stops the scan; a NUL that is part of the input is then
+	// resolved through yy_nul_trans
+	std::vector<int> classes(_dfa.getClassMap().begin(), _dfa.getClassMap().end());
+	classes[0] = static_cast<int>(classCount);
+	emitArray(out, intType(static_cast<long>(classCount)), "yy_ec", classes);
+
+	std::vector<int> nulTransitions(stateCount);
+	for (size_t s = 0; s < stateCount; ++s) {
+		nulTransitions[s] = static_cast<int>(_dfa.getTransition(s, _dfa.getClass(0)));
+	}
+	emitArray(out, intType(static_cast<long>(stateCount)), "yy_nul_trans", nulTransitions);
+
+	std::vector<int> accept(stateCount);
+	for (size_t s = 0; s < stateCount; ++s) {
+		accept[s] = _dfa.getAcceptRule(s) + 1;
+	}
+	emitArray(out, intType(static_cast<long>(_content.rules.size()) + 1), "yy_accept", accept);
+
+	std::vector<int> starts;
+	for (auto [condition, atLineStart] : startEntries()) {
+		starts.push_back(static_cast<int>(_dfa.getStartState(condition, atLineStart)));
+	}
+	emitArray(out, intType(static_cast<long>(stateCount)), "yy_start_state", starts);
+
+	if (hasSkipLoops()) {
+		emitArray(out, intType(static_cast<long>(_skipLoops.size()), -1), "yy_skip_state", _skipIndex);
+	}
+
+	if (mode == FULL) {
+		const char *type = intType(static_cast<long>(stateCount));
+		out << "static const " << type << " yy_nxt[" << stateCount << "][" << classCount + 1 << "] = {\n";
+		for (size_t s = 0; s < stateCount; ++s) {
+			out << "\t{ ";
+			for (size_t c = 0; c < classCount; ++c) {
+				out << _dfa.getTransition(s, c) << ", ";
+			}
+			out << Dfa::DEAD_STATE << " }" << (s + 1 < stateCount ? "," : "") << "\n";
+		}
+		out << "};\n\n";
+		out << "#define YY_NEXT(state, cls) yy_nxt[state][cls]\n\n";
+		return;
+	}
+
+	long states = static_cast<long>(stateCount);
+	emitArray(out, intType(static_cast<long>(_next.size())), "yy_base", _base);
+	emitArray(out, intType(states, -1), "yy_def", _default);
+	emitArray(out, intType(states), "yy_nxt", _next);
+	emitArray(out, intType(states, -1), "yy_chk", _check);
+	out << "static int yy_next_state(int state, int cls)\n";
+	out << "{\n";
+	out << "\twhile (state >= 0 && yy_chk[yy_base[state] + cls] != state)\n";
+	out << "\t\tstate = yy_def[state];\n";
+	out << "\treturn state < 0 ? 0 : yy_nxt[yy_base[state] + cls];\n";
+	out << "}\n\n";
+	out << "#define YY_NEXT(state, cls) yy_next_state(state, cls)\n\n";
+}
+
+void CodeGenerator::emitScanner(std::ostream &out, const std::string &matcher, bool direct) const {
+	if (_reentrant) {
+		out << "__attribute__((weak)) int yywrap(yyscan_t yyscanner)\n{\n\t(void)yyscanner;\n\treturn 1;\n}\n\n";
+	} else {
+		out << "__attribute__((weak)) int yywrap(void)\n{\n\treturn 1;\n}\n\n";
+	}
+	out << R"(#ifdef YY_USE_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Maps what is left of a regular file as a single buffer. The mapping is
+   followed by at least one zero byte, from the last page of the file or from
+   the anonymous page behind it, which serves as the sentinel. */
+static int yy_map_input(YY_ONLY_ARG)
+{
+	YY_DECL_GUTS
+	struct stat st;
+	off_t offset;
+	size_t page;
+	size_t size;
+	char *region;
+
+	if (fstat(fileno(yyin), &st) != 0 || !S_ISREG(st.st_mode))
+		return 0;
+	offset = ftello(yyin);
+	if (offset < 0 || st.st_size - offset < YY_MMAP_MIN)
+		return 0;
+	page = (size_t)sysconf(_SC_PAGESIZE);
+	size = ((size_t)st.st_size / page + 1) * page;
+	region = (char *)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (region == MAP_FAILED)
+		return 0;
+	if (mmap(region, (size_t)st.st_size, YY_MMAP_PROT, MAP_PRIVATE | MAP_FIXED, fileno(yyin), 0) == MAP_FAILED) {
+		munmap(region, size);
+		return 0;
+	}
+	madvise(region, (size_t)st.st_size, MADV_SEQUENTIAL);
+	fseeko(yyin, 0, SEEK_END);
+	free(yy_buf);
+	yy_buf = region;
+	yy_buf_cap = size;
+	yy_buf_len = (size_t)st.st_size;
+	yy_cp = (size_t)offset;
+	yy_mapped = 1;
+	yy_eof_seen = 1;
+	return 1;
+}
+
+static void yy_unmap_input(YY_ONLY_ARG)
+{
+	YY_DECL_GUTS
+	munmap(yy_buf, yy_buf_cap);
+}
+
+#else
+#define yy_map_input(scanner) 0
+#define yy_unmap_input(scanner)
+#endif
+
+/* Terminal input is read a line at a time, so that the tokens of a line come
+   out as soon as it is typed, with or without YY_USE_MMAP. */
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+
+static int yy_is_interactive(YY_ONLY_ARG)
+{
+	YY_DECL_GUTS
+	return isatty(fileno(yyin));
+}
+#else
+#define yy_is_interactive(scanner) 0
+#endif
+
+/* Drops the text before yy_cp and appends more input, growing the buffer when
+   the pending token leaves less than half of YY_BUF_SIZE free. The byte after
+   the data is always a NUL sentinel. Returns 0 at end of input. */
+static int yy_fill(YY_ONLY_ARG)
+{
+	YY_DECL_GUTS
+	size_t room;
+	size_t n;
+	int c;
+
+	if (yy_eof_seen)
+		return 0;
+	if (!yy_map_tried) {
+		yy_map_tried = 1;
+		if (yy_map_input(YY_CALL_ONLY_ARG))
+			return 1;
+	}
+	if (yy_cp > 0) {
+		memmove(yy_buf, yy_buf + yy_cp, yy_buf_len - yy_cp);
+		yy_buf_len -= yy_cp;
+		yy_cp = 0;
+	}
+	if (yy_buf_len + 1 + (YY_BUF_SIZE + 1) / 2 > yy_buf_cap) {
+		if (!yy_buf_cap)
+			yy_buf_cap = YY_BUF_SIZE + 1;
+		while (yy_buf_len + 1 + (YY_BUF_SIZE + 1) / 2 > yy_buf_cap)
+			yy_buf_cap *= 2;
+		yy_buf = (char *)realloc(yy_buf, yy_buf_cap);
+		if (!yy_buf) {
+			fprintf(stderr, "ft_lex scanner: out of memory\n");
+			exit(2);
+		}
+	}
+	room = yy_buf_cap - yy_buf_len - 1;
+	if (yy_is_interactive(YY_CALL_ONLY_ARG)) {
+		n = 0;
+		while (n < room && (c = getc(yyin)) != EOF) {
+			yy_buf[yy_buf_len + n++] = (char)c;
+			if (c == '\n')
+				break;
+		}
+	} else {
+		n = fread(yy_buf + yy_buf_len, 1, room, yyin);
+	}
+	yy_buf_len += n;
+	yy_buf[yy_buf_len] = '\0';
+	if (n == 0) {
+		yy_eof_seen = 1;
+		return 0;
+	}
+	return 1;
+}
+
+/* Refills in the middle of a token: p keeps pointing at the same input byte,
+   even when the text moved and no input was left. */
+static int yy_more_input(char **p YY_LAST_ARG)
+{
+	YY_DECL_GUTS
+	size_t scanned = (size_t)(*p - yy_buf) - yy_cp;
+	int more = yy_fill(YY_CALL_ONLY_ARG);
+
+	*p = yy_buf + yy_cp + scanned;
+	return more;
+}
+
+/* Forgets the exhausted input after yywrap() switched yyin. */
+static void yy_reset_input(YY_ONLY_ARG)
+{
+	YY_DECL_GUTS
+	if (yy_mapped) {
+		yy_unmap_input(YY_CALL_ONLY_ARG);
+		yy_buf = NULL;
+		yy_buf_cap = 0;
+		yy_mapped = 0;
+	} else if (yy_buf) {
+		yy_buf[0] = '\0';
+	}
+	yy_buf_len = 0;
+	yy_cp = 0;
+	yy_hold_char = '\0';
+	yy_eof_seen = 0;
+	yy_map_tried = 0;
+}
+
+)";
+	if (hasSkipLoops()) {
+		emitSkipLoops(out);
+	}
+	if (_dfa.getFallbackCount() > 0) {
+		emitNfaFallback(out);
+	}
+	if (hasKeywords()) {
+		emitKeywordLookup(out);
+	}
+	emitScannerApi(out);
+	out << R"(int yylex(YY_ONLY_ARG)
+{
+	YY_DECL_GUTS
+)";
+	if (!direct) {
+		out << "\tint yy_state;\n";
+		out << "\tint yy_next;\n";
+	}
+	if (hasSkipLoops()) {
+		out << "\tsize_t yy_k;\n";
+	}
+	out << R"(	int yy_rule;
+	char *yy_p;
+	size_t yy_match_len;
+
+	if (!yyin)
+		yyin = stdin;
+	if (!yyout)
+		yyout = stdout;
+	for (;;) {
+)";
+	if (_content.yytextType == LexFileParser::Content::POINTER) {
+		out << "\t\tif (yy_buf)\n\t\t\tyy_buf[yy_cp] = yy_hold_char;\n";
+	}
+	out << R"(		if (yy_cp == yy_buf_len && !yy_fill(YY_CALL_ONLY_ARG)) {
+			if (yywrap(YY_CALL_ONLY_ARG))
+				return 0;
+			yy_reset_input(YY_CALL_ONLY_ARG);
+)";
+	if (_nfa.hasLineStartRules()) {
+		out << "\t\t\tyy_at_bol = 1;\n";
+	}
+	out << R"(			continue;
+		}
+		yy_rule = -1;
+		yy_match_len = 0;
+		yy_p = yy_buf + yy_cp;
+)";
+	out << matcher;
+	if (_dfa.getFallbackCount() > 0) {
+		out << "\t\tyy_nfa_match(&yy_rule, &yy_match_len YY_CALL_LAST_ARG);\n";
+	}
+	if (hasKeywords()) {
+		out << "\t\tyy_rule = yy_keyword(yy_rule, yy_buf + yy_cp, yy_match_len);\n";
+	}
+	out << R"(		if (yy_rule < 0) {
+			yy_rule = YY_NUM_RULES;
+			yy_match_len = 1;
+		}
+)";
+	if (_content.yytextType == LexFileParser::Content::ARRAY) {
+		out << R"(		if (yy_match_len >= YYLMAX) {
+			fprintf(stderr, "ft_lex scanner: token longer than YYLMAX\n");
+			exit(2);
+		}
+		memcpy(yytext, yy_buf + yy_cp, yy_match_len);
+		yytext[yy_match_len] = '\0';
+		yyleng = (int)yy_match_len;
+		yy_cp += yy_match_len;
+)";
+	} else {
+		out << R"(		yytext = yy_buf + yy_cp;
+		yyleng = (int)yy_match_len;
+		yy_cp += yy_match_len;
+		yy_hold_char = yy_buf[yy_cp];
+		yy_buf[yy_cp] = '\0';
+)";
+	}
+	if (_nfa.hasLineStartRules()) {
+		out << "\t\tyy_at_bol = yytext[yyleng - 1] == '\\n';\n";
+	}
+	out << "\t\tswitch (yy_rule) {\n";
+	emitActions(out);
+	out << "\t\tdefault:\n";
+	out << "\t\t\tECHO;\n";
+	out << "\t\t\tYY_BREAK\n";
+	out << "\t\t}\n";
+	out << "\t}\n";
+	out << "}\n\n";
+}
+
+// yy_scan_bytes() and yy_scan_string() scan a copy of a string instead of
+// yyin, in both modes. A reentrant scanner also gets the flex functions that
+// create and destroy it and reach its state from outside the actions.
+void CodeGenerator::emitScannerApi(std::ostream &out) const {
+	out << R"(/* Scans a copy of bytes[0 .. len) instead of yyin, from the start of a line.
+   yywrap() is called at its end as at the end of a file. Returns -1 when out
+   of memory. */
+int yy_scan_bytes(const char *bytes, size_t len YY_LAST_ARG)
+{
+	YY_DECL_GUTS
+	char *copy = (char *)malloc(len + 1);
+
+	if (!copy)
+		return -1;
+	memcpy(copy, bytes, len);
+	copy[len] = '\0';
+	if (yy_mapped)
+		yy_unmap_input(YY_CALL_ONLY_ARG);
+	else
+		free(yy_buf);
+	yy_buf = copy;
+	yy_buf_cap = len + 1;
+	yy_buf_len = len;
+	yy_cp = 0;
+	yy_hold_char = copy[0];
+	yy_eof_seen = 1;
+	yy_mapped = 0;
+	yy_map_tried = 1;
+)";
+	if (_nfa.hasLineStartRules()) {
+		out << "\tyy_at_bol = 1;\n";
+	}
+	out << R"(	return 0;
+}
+
+int yy_scan_string(const char *str YY_LAST_ARG)
+{
+	return yy_scan_bytes(str, strlen(str) YY_CALL_LAST_ARG);
+}
+
+)";
+	if (!_reentrant) {
+		return;
+	}
+	out << R"(/* Both return nonzero, and leave *scanner NULL, when out of memory. */
+int yylex_init_extra(YY_EXTRA_TYPE extra, yyscan_t *scanner)
+{
+	struct yyguts_t *yyg = (struct yyguts_t *)calloc(1, sizeof(struct yyguts_t));
+
+	*scanner = yyg;
+	if (!yyg)
+		return 1;
+	yyextra = extra;
+	yy_start = INITIAL;
+)";
+	if (_nfa.hasLineStartRules()) {
+		out << "\tyy_at_bol = 1;\n";
+	}
+	out << R"(	return 0;
+}
+
+int yylex_init(yyscan_t *scanner)
+{
+	return yylex_init_extra(NULL, scanner);
+}
+
+int yylex_destroy(yyscan_t yyscanner)
+{
+	YY_DECL_GUTS
+	if (!yyg)
+		return 0;
+	if (yy_mapped)
+		yy_unmap_input(YY_CALL_ONLY_ARG);
+	else
+		free(yy_buf);
+	free(yyg);
+	return 0;
+}
+
+FILE *yyget_in(yyscan_t yyscanner)
+{
+	YY_DECL_GUTS
+	return yyin;
+}
+
+void yyset_in(FILE *in, yyscan_t yyscanner)
+{
+	YY_DECL_GUTS
+	yyin = in;
+}
+
+FILE *yyget_out(yyscan_t yyscanner)
+{
+	YY_DECL_GUTS
+	return yyout;
+}
+
+void yyset_out(FILE *out, yyscan_t yyscanner)
+{
+	YY_DECL_GUTS
+	yyout = out;
+}
+
+char *yyget_text(yyscan_t yyscanner)
+{
+	YY_DECL_GUTS
+	return yytext;
+}
+
+int yyget_leng(yyscan_t yyscanner)
+{
+	YY_DECL_GUTS
+	return yyleng;
+}
+
+YY_EXTRA_TYPE yyget_extra(yyscan_t yyscanner)
+{
+	YY_DECL_GUTS
+	return yyextra;
+}
+
+void yyset_extra(YY_EXTRA_TYPE extra, yyscan_t yyscanner)
+{
+	YY_DECL_GUTS
+	yyextra = extra;
+}
+
+)";
+}
+
+// yy_skip(p, n, i) returns how many leading bytes of p[0 .. n) belong to the
+// loop set of skip loop i. x86 builds pick an AVX2 or SSE2 version on first
+// use; other targets, or YY_NO_SIMD, use the scalar loop.
+void CodeGenerator::emitSkipLoops(std::ostream &out) const {
+	out << "static const unsigned char yy_skip_ranges[" << _skipLoops.size() << "][" << 2 * MAX_SKIP_RANGES << "] = {\n";
+	for (size_t i = 0; i < _skipLoops.size(); ++i) {
+		out << "\t{ ";
+		for (size_t r = 0; r < MAX_SKIP_RANGES; ++r) {
+			if (r < _skipLoops[i].ranges.size()) {
+				out << static_cast<int>(_skipLoops[i].ranges[r].first) << ", " << static_cast<int>(_skipLoops[i].ranges[r].second);
+			} else {
+				out << "0, 0";
+			}
+			out << (r + 1 < MAX_SKIP_RANGES ? ", " : " ");
+		}
+		out << "}" << (i + 1 < _skipLoops.size() ? "," : "") << "\n";
+	}
+	out << "};\n\n";
+	std::vector<int> counts;
+	std::vector<int> negate;
+	for (const auto &skip : _skipLoops) {
+		counts.push_back(static_cast<int>(skip.ranges.size()));
+		negate.push_back(skip.negate ? 1 : 0);
+	}
+	emitArray(out, "signed char", "yy_skip_count", counts);
+	emitArray(out, "signed char", "yy_skip_negate", negate);
+	out << R"(typedef size_t (*yy_skip_fn)(const unsigned char *, size_t, const unsigned char *, int, int);
+
+static size_t yy_skip_scalar(const unsigned char *p, size_t n, const unsigned char *r, int count, int negate)
+{
+	size_t i;
+	int j;
+	int in;
+
+	for (i = 0; i < n; ++i) {
+		in = 0;
+		for (j = 0; j < count; ++j) {
+			if ((unsigned char)(p[i] - r[2 * j]) <= (unsigned char)(r[2 * j + 1] - r[2 * j])) {
+				in = 1;
+				break;
+			}
+		}
+		if (in == negate)
+			break;
+	}
+	return i;
+}
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && !defined(YY_NO_SIMD)
+#include <immintrin.h>
+
+__attribute__((target("sse2")))
+static size_t yy_skip_sse2(const unsigned char *p, size_t n, const unsigned char *r, int count, int negate)
+{
+	__m128i lo[4];
+	__m128i span[4];
+	__m128i x, d, in;
+	unsigned int mask;
+	size_t i = 0;
+	int j;
+
+	for (j = 0; j < count; ++j) {
+		lo[j] = _mm_set1_epi8((char)r[2 * j]);
+		span[j] = _mm_set1_epi8((char)(r[2 * j + 1] - r[2 * j]));
+	}
+	for (; i + 16 <= n; i += 16) {
+		x = _mm_loadu_si128((const __m128i *)(p + i));
+		in = _mm_setzero_si128();
+		for (j = 0; j < count; ++j) {
+			d = _mm_sub_epi8(x, lo[j]);
+			in = _mm_or_si128(in, _mm_cmpeq_epi8(_mm_max_epu8(d, span[j]), span[j]));
+		}
+		mask = (unsigned int)_mm_movemask_epi8(in);
+		if (negate)
+			mask = ~mask & 0xFFFFu;
+		if (mask != 0xFFFFu)
+			return i + (size_t)__builtin_ctz(~mask);
+	}
+	return i + yy_skip_scalar(p + i, n - i, r, count, negate);
+}
+
+__attribute__((target("avx2")))
+static size_t yy_skip_avx2(const unsigned char *p, size_t n, const unsigned char *r, int count, int negate)
+{
+	__m256i lo[4];
+	__m256i span[4];
+	__m256i x, d, in;
+	unsigned int mask;
+	size_t i = 0;
+	int j;
+
+	for (j = 0; j < count; ++j) {
+		lo[j] = _mm256_set1_epi8((char)r[2 * j]);
+		span[j] = _mm256_set1_epi8((char)(r[2 * j + 1] - r[2 * j]));
+	}
+	for (; i + 32 <= n; i += 32) {
+		x = _mm256_loadu_si256((const __m256i *)(p + i));
+		in = _mm256_setzero_si256();
+		for (j = 0; j < count; ++j) {
+			d = _mm256_sub_epi8(x, lo[j]);
+			in = _mm256_or_si256(in, _mm256_cmpeq_epi8(_mm256_max_epu8(d, span[j]), span[j]));
+		}
+		mask = (unsigned int)_mm256_movemask_epi8(in);
+		if (negate)
+			mask = ~mask;
+		if (mask != 0xFFFFFFFFu)
+			return i + (size_t)__builtin_ctz(~mask);
+	}
+	return i + yy_skip_sse2(p + i, n - i, r, count, negate);
+}
+
+static yy_skip_fn yy_skip_select(void)
+{
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return yy_skip_avx2;
+	if (__builtin_cpu_supports("sse2"))
+		return yy_skip_sse2;
+	return yy_skip_scalar;
+}
+#else
+static yy_skip_fn yy_skip_select(void)
+{
+	return yy_skip_scalar;
+}
+#endif
+
+static yy_skip_fn yy_skip_impl = NULL;
+
+/* Scanners on several threads may select at once; they store the same. */
+static size_t yy_skip(const char *p, size_t n, int loop)
+{
+	yy_skip_fn impl = __atomic_load_n(&yy_skip_impl, __ATOMIC_RELAXED);
+
+	if (!impl) {
+		impl = yy_skip_select();
+		__atomic_store_n(&yy_skip_impl, impl, __ATOMIC_RELAXED);
+	}
+	return impl((const unsigned char *)p, n, yy_skip_ranges[loop], yy_skip_count[loop], yy_skip_negate[loop]);
+}
+
+)";
+}
+
+// The states of the fallback rules and the shared prefix states, renumbered
+// from 0, with their edges in CSR form, and for each start condition the
+// entry states of the fallback rules active in it. Edges into the other rules
+// are dropped, and only the fallback rules accept. yy_nfa_match() runs a Thompson simulation over them:
+// time and memory stay linear in the number of states, however many subsets
+// the rules would have produced.
+void CodeGenerator::emitNfaFallback(std::ostream &out) const {
+	const std::vector<bool> &fallback = _dfa.getFallbackRules();
+	std::vector<Nfa::StateId> states = fallbackStates();
+	std::vector<int> index(_nfa.getStateCount(), -1);
+	for (size_t i = 0; i < states.size(); ++i) {
+		index[states[i]] = static_cast<int>(i);
+	}
+	long count = static_cast<long>(states.size());
+
+	std::vector<int> accept;
+	std::vector<int> epsilonBase = { 0 };
+	std::vector<int> epsilon;
+	std::vector<int> edgeBase = { 0 };
+	std::vector<int> lo;
+	std::vector<int> hi;
+	std::vector<int> target;
+	for (Nfa::StateId s : states) {
+		int32_t rule = _nfa.getAcceptRule(s);
+		accept.push_back(rule != Nfa::NO_RULE && fallback[rule] ? rule + 1 : 0);
+		for (Nfa::StateId t : _nfa.getEpsilonEdges(s)) {
+			if (index[t] >= 0) {
+				epsilon.push_back(index[t]);
+			}
+		}
+		epsilonBase.push_back(static_cast<int>(epsilon.size()));
+		// the scanner tests byte ranges, one entry per run of the set
+		for (const auto &edge : _nfa.getSetEdges(s)) {
+			if (index[edge.target] < 0) {
+				continue;
+			}
+			_nfa.getSet(edge.set).forEachRange([&](uint8_t first, uint8_t last) {
+				lo.push_back(first);
+				hi.push_back(last);
+				target.push_back(index[edge.target]);
+			});
+		}
+		edgeBase.push_back(static_cast<int>(target.size()));
+	}
+	std::vector<int> startBase = { 0 };
+	std::vector<int> start;
+	for (auto [condition, atLineStart] : startEntries()) {
+		// the start state at the start of a line leads to the other one
+		std::vector<Nfa::StateId> entered = { _nfa.getStartState(condition) };
+		if (atLineStart) {
+			entered.push_back(_nfa.getStartState(condition, true));
+		}
+		for (Nfa::StateId s : entered) {
+			for (Nfa::StateId t : _nfa.getEpsilonEdges(s)) {
+				if (index[t] >= 0) {
+					start.push_back(index[t]);
+				}
+			}
+		}
+		startBase.push_back(static_cast<int>(start.size()));
+	}
+	// C rejects empty arrays
+	for (auto *values : { &epsilon, &target, &lo, &hi, &start }) {
+		if (values->empty()) {
+			values->push_back(0);
+		}
+	}
+
+	emitArray(out, intType(static_cast<long>(_content.rules.size()) + 1), "yy_nfa_accept", accept);
+	emitArray(out, intType(static_cast<long>(epsilon.size())), "yy_nfa_eps_base", epsilonBase);
+	emitArray(out, intType(count), "yy_nfa_eps", epsilon);
+	emitArray(out, intType(static_cast<long>(target.size())), "yy_nfa_edge_base", edgeBase);
+	emitArray(out, "unsigned char", "yy_nfa_lo", lo);
+	emitArray(out, "unsigned char", "yy_nfa_hi", hi);
+	emitArray(out, intType(count), "yy_nfa_to", target);
+	emitArray(out, intType(static_cast<long>(start.size())), "yy_nfa_start_base", startBase);
+	emitArray(out, intType(count), "yy_nfa_start", start);
+	out << R"(static void yy_nfa_new_set(YY_ONLY_ARG)
+{
+	YY_DECL_GUTS
+	if (++yy_nfa_gen == 0) {
+		memset(yy_nfa_mark, 0, sizeof(yy_nfa_mark));
+		yy_nfa_gen = 1;
+	}
+}
+
+/* Adds the epsilon closure of state to the n states of set, each state at
+   most once per set. Returns the new size. */
+static size_t yy_nfa_add(int *set, size_t n, int state YY_LAST_ARG)
+{
+	YY_DECL_GUTS
+	size_t top = 0;
+	int e;
+
+	if (yy_nfa_mark[state] == yy_nfa_gen)
+		return n;
+	yy_nfa_mark[state] = yy_nfa_gen;
+	yy_nfa_stack[top++] = state;
+	while (top) {
+		state = yy_nfa_stack[--top];
+		set[n++] = state;
+		for (e = yy_nfa_eps_base[state]; e < yy_nfa_eps_base[state + 1]; ++e) {
+			if (yy_nfa_mark[yy_nfa_eps[e]] != yy_nfa_gen) {
+				yy_nfa_mark[yy_nfa_eps[e]] = yy_nfa_gen;
+				yy_nfa_stack[top++] = yy_nfa_eps[e];
+			}
+		}
+	}
+	return n;
+}
+
+/* Matches the fallback rules from the start of the token and takes their
+   match over the DFA's when it is longer, or as long from an earlier rule. */
+static void yy_nfa_match(int *rule, size_t *match_len YY_LAST_ARG)
+{
+	YY_DECL_GUTS
+	int *current = yy_nfa_sets[0];
+	int *next = yy_nfa_sets[1];
+	int *swap;
+	size_t n = 0;
+	size_t m;
+	size_t i;
+	size_t len;
+	int e;
+	int best;
+	unsigned char c;
+	char *p = yy_buf + yy_cp;
+
+	yy_nfa_new_set(YY_CALL_ONLY_ARG);
+)";
+	out << "\tfor (e = yy_nfa_start_base[" << startIndex() << "]; e < yy_nfa_start_base[" << startIndex() << " + 1]; ++e)\n";
+	out << R"(		n = yy_nfa_add(current, n, yy_nfa_start[e] YY_CALL_LAST_ARG);
+	while (n) {
+		if (*p == '\0' && p == yy_buf + yy_buf_len && !yy_more_input(&p YY_CALL_LAST_ARG))
+			break;
+		c = (unsigned char)*p++;
+		yy_nfa_new_set(YY_CALL_ONLY_ARG);
+		m = 0;
+		best = -1;
+		for (i = 0; i < n; ++i) {
+			for (e = yy_nfa_edge_base[current[i]]; e < yy_nfa_edge_base[current[i] + 1]; ++e) {
+				if (c >= yy_nfa_lo[e] && c <= yy_nfa_hi[e])
+					m = yy_nfa_add(next, m, yy_nfa_to[e] YY_CALL_LAST_ARG);
+			}
+		}
+		for (i = 0; i < m; ++i) {
+			if (yy_nfa_accept[next[i]] && (best < 0 || yy_nfa_accept[next[i]] - 1 < best))
+				best = yy_nfa_accept[next[i]] - 1;
+		}
+		if (best >= 0) {
+			len = (size_t)(p - yy_buf) - yy_cp;
+			if (len > *match_len || (len == *match_len && best < *rule)) {
+				*rule = best;
+				*match_len = len;
+			}
+		}
+		swap = current;
+		current = next;
+		next = swap;
+		n = m;
+	}
+}
+
+)";
+}
+
+// yy_keyword(rule, s, n) returns the keyword rule spelled by the lexeme s of
+// length n when rule is an identifier rule, and rule otherwise. Each
+// identifier rule's keywords are in a perfect hash (see KeywordTable), so a
+// lookup hashes the lexeme once and ends in one memcmp() at most.
+void CodeGenerator::emitKeywordLookup(std::ostream &out) const {
+	out << R"(/* KeywordTable::hash() and KeywordTable::mix() */
+static unsigned long long yy_keyword_hash(const char *s, size_t n, unsigned long long seed)
+{
+	unsigned long long h = 14695981039346656037ULL ^ seed;
+	size_t i;
+
+	for (i = 0; i < n; ++i)
+		h = (h ^ (unsigned char)s[i]) * 1099511628211ULL;
+	return h;
+}
+
+static unsigned long long yy_keyword_mix(unsigned long long h)
+{
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return h;
+}
+
+)";
+	std::ostringstream lookup;
+	for (const auto &[identifier, keywords] : _keywords->getTables()) {
+		KeywordTable::PerfectHash table = KeywordTable::buildPerfectHash(keywords);
+		std::string prefix = "yy_kw" + std::to_string(identifier) + "_";
+		std::vector<int> text;
+		std::vector<size_t> offsets(table.slots.size(), 0);
+		std::vector<size_t> lengths(table.slots.size(), 0);
+		std::vector<size_t> rules(table.slots.size(), 0);
+		size_t minLength = SIZE_MAX;
+		size_t maxLength = 0;
+		size_t maxRule = 0;
+		for (size_t slot = 0; slot < table.slots.size(); ++slot) {
+			if (table.slots[slot] < 0) {
+				continue;
+			}
+			const KeywordTable::Keyword &keyword = keywords[static_cast<size_t>(table.slots[slot])];
+			offsets[slot] = text.size();
+			lengths[slot] = keyword.text.size();
+			rules[slot] = keyword.rule;
+			for (char c : keyword.text) {
+				text.push_back(static_cast<uint8_t>(c));
+			}
+			minLength = std::min(minLength, keyword.text.size());
+			maxLength = std::max(maxLength, keyword.text.size());
+			maxRule = std::max(maxRule, keyword.rule);
+		}
+		uint32_t maxDisplacement = *std::max_element(table.displacements.begin(), table.displacements.end());
+		emitArray(out, intType(maxDisplacement), prefix + "disp", table.displacements);
+		emitArray(out, intType(static_cast<long>(text.size())), prefix + "off", offsets);
+		emitArray(out, intType(static_cast<long>(maxLength)), prefix + "len", lengths);
+		emitArray(out, intType(static_cast<long>(maxRule)), prefix + "rule", rules);
+		emitArray(out, "unsigned char", prefix + "text", text);
+
+		lookup << "\tcase " << identifier << ":\n";
+		lookup << "\t\tif (n >= " << minLength << " && n <= " << maxLength << ") {\n";
+		lookup << "\t\t\th = yy_keyword_hash(s, n, " << table.seed << "ULL);\n";
+		lookup << "\t\t\tslot = yy_keyword_mix(h + " << prefix << "disp[yy_keyword_mix(h) % " << table.displacements.size()
+			<< "] * 0x9e3779b97f4a7c15ULL) % " << table.slots.size() << ";\n";
+		lookup << "\t\t\tif ((size_t)" << prefix << "len[slot] == n && memcmp(s, " << prefix << "text + " << prefix << "off[slot], n) == 0)\n";
+		lookup << "\t\t\t\treturn " << prefix << "rule[slot];\n";
+		lookup << "\t\t}\n";
+		lookup << "\t\tbreak;\n";
+	}
+	out << "static int yy_keyword(int rule, const char *s, size_t n)\n{\n";
+	out << "\tunsigned long long h;\n";
+	out << "\tsize_t slot;\n\n";
+	out << "\tswitch (rule) {\n";
+	out << lookup.str();
+	out << "\t}\n";
+	out << "\treturn rule;\n";
+	out << "}\n\n";
+}
+
+void CodeGenerator::emitActions(std::ostream &out) const {
+	for (size_t r = 0; r < _content.rules.size(); ++r) {
+		const auto &rule = _content.rules[r];
+		out << "\t\tcase " << r << ":\n";
+		if (rule.action == "|") {
+			continue;
+		}
+		out << "\t\t\t" << rule.action << "\n";
+		out << "\t\t\tYY_BREAK\n";
+	}
+}
+
+// yy_scan_parallel() splits an in-memory input into chunks claimed by
+// pthreads through an atomic counter. Each chunk is tokenized as if a token
+// started on its first byte, then the chunks are stitched in order, with a
+// sequential rescan wherever the speculation guessed a wrong boundary. Only
+// table-driven scanners have it, since it walks the same tables as yylex().
+void CodeGenerator::emitParallelScan(std::ostream &out) const {
+	out << R"(#ifdef YY_PARALLEL
+#include <pthread.h>
+
+/* Tokens are delivered in input order, as successive yylex() calls would
+   match them from INITIAL. Actions are not run, so nothing that an action
+   does, BEGIN included, affects the scan. Returns -1 when out of memory. */
+typedef void (*yy_token_fn)(int rule, const char *text, size_t len, void *ctx);
+
+struct yy_par_token {
+	size_t start;
+	size_t len;
+	int rule;
+};
+
+struct yy_par_chunk {
+	size_t begin;
+	size_t limit;
+	size_t end;
+	struct yy_par_token *tokens;
+	size_t count;
+	size_t cap;
+	int failed;
+};
+
+struct yy_par_job {
+	const char *data;
+	size_t len;
+	struct yy_par_chunk *chunks;
+	size_t nchunks;
+	size_t next;
+};
+
+static size_t yy_par_match(const char *data, size_t len, size_t start, int *rule)
+{
+)";
+	if (_nfa.hasLineStartRules()) {
+		out << "\tint state = yy_start_state[INITIAL * 2 + (start == 0 || data[start - 1] == '\\n')];\n";
+	} else {
+		out << "\tint state = yy_start_state[INITIAL];\n";
+	}
+	out << R"(	int next;
+	unsigned char c;
+	size_t n = 0;
+	size_t matched = 1;
+
+	*rule = YY_NUM_RULES;
+	while (start + n < len) {
+		c = (unsigned char)data[start + n];
+		next = c ? YY_NEXT(state, yy_ec[c]) : yy_nul_trans[state];
+		if (next == 0)
+			break;
+		state = next;
+		++n;
+)";
+	if (!_backup.empty()) {
+		out << R"(		if (yy_accept[state]) {
+			*rule = yy_accept[state] - 1;
+			matched = n;
+		}
+	}
+)";
+	} else {
+		out << R"(	}
+	if (n && yy_accept[state]) {
+		*rule = yy_accept[state] - 1;
+		matched = n;
+	}
+)";
+	}
+	if (hasKeywords()) {
+		out << "\t*rule = yy_keyword(*rule, data + start, matched);\n";
+	}
+	out << R"(	return matched;
+}
+
+static void *yy_par_worker(void *arg)
+{
+	struct yy_par_job *job = (struct yy_par_job *)arg;
+	struct yy_par_chunk *chunk;
+	struct yy_par_token *grown;
+	size_t i;
+	size_t pos;
+	int rule;
+
+	while ((i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) < job->nchunks) {
+		chunk = &job->chunks[i];
+		pos = chunk->begin;
+		while (pos < chunk->limit) {
+			if (chunk->count == chunk->cap) {
+				chunk->cap = chunk->cap ? chunk->cap * 2 : 1024;
+				grown = (struct yy_par_token *)realloc(chunk->tokens, chunk->cap * sizeof(*grown));
+				if (!grown) {
+					chunk->failed = 1;
+					break;
+				}
+				chunk->tokens = grown;
+			}
+			chunk->tokens[chunk->count].start = pos;
+			chunk->tokens[chunk->count].len = yy_par_match(job->data, job->len, pos, &rule);
+			chunk->tokens[chunk->count].rule = rule;
+			pos += chunk->tokens[chunk->count++].len;
+		}
+		chunk->end = pos;
+	}
+	return NULL;
+}
+
+int yy_scan_parallel(const char *data, size_t len, int threads, yy_token_fn emit, void *ctx)
+{
+	struct yy_par_job job;
+	struct yy_par_chunk *chunk;
+	pthread_t *workers;
+	size_t size;
+	size_t pos = 0;
+	size_t lo, hi, mid;
+	size_t i;
+	int started = 0;
+	int rule;
+	int failed = 0;
+
+	if (threads < 1)
+		threads = 1;
+	job.data = data;
+	job.len = len;
+	job.nchunks = (size_t)threads * 4;
+	job.next = 0;
+	size = (len + job.nchunks - 1) / job.nchunks;
+	if (size == 0)
+		size = 1;
+	job.chunks = (struct yy_par_chunk *)calloc(job.nchunks, sizeof(*job.chunks));
+	workers = (pthread_t *)malloc((size_t)threads * sizeof(*workers));
+	if (!job.chunks || !workers) {
+		free(job.chunks);
+		free(workers);
+		return -1;
+	}
+	for (i = 0; i < job.nchunks; ++i) {
+		job.chunks[i].begin = i * size < len ? i * size : len;
+		job.chunks[i].limit = (i + 1) * size < len ? (i + 1) * size : len;
+	}
+	while (started < threads - 1 && pthread_create(&workers[started], NULL, yy_par_worker, &job) == 0)
+		++started;
+	yy_par_worker(&job);
+	while (started > 0)
+		pthread_join(workers[--started], NULL);
+	free(workers);
+
+	for (i = 0; i < job.nchunks; ++i)
+		failed |= job.chunks[i].failed;
+	for (i = 0; i < job.nchunks && !failed; ++i) {
+		chunk = &job.chunks[i];
+		if (pos >= chunk->limit)
+			continue;
+		/* first speculative token at or after pos */
+		lo = 0;
+		hi = chunk->count;
+		while (lo < hi) {
+			mid = lo + (hi - lo) / 2;
+			if (chunk->tokens[mid].start < pos)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		while (pos < chunk->limit) {
+			if (lo < chunk->count && chunk->tokens[lo].start == pos) {
+				for (; lo < chunk->count; ++lo)
+					emit(chunk->tokens[lo].rule, data + chunk->tokens[lo].start, chunk->tokens[lo].len, ctx);
+				pos = chunk->end;
+				break;
+			}
+			size = yy_par_match(data, len, pos, &rule);
+			emit(rule, data + pos, size, ctx);
+			pos += size;
+			while (lo < chunk->count && chunk->tokens[lo].start < pos)
+				++lo;
+		}
+	}
+	for (i = 0; i < job.nchunks; ++i)
+		free(job.chunks[i].tokens);
+	free(job.chunks);
+	return failed ? -1 : 0;
+}
+#endif
+
+)";
+}
+
+void CodeGenerator::emitEpilogue(std::ostream &out) const {
+	for (const auto &line : _content.userSubroutinesCode) {
+		out << line << "\n";
+	}
+}
+
+// The scan only stops on a dead transition. yy_ec sends the NUL sentinel
+// behind the data to a dead column, so the end of the buffer needs no test of
+// its own: a stop on a NUL byte is either the sentinel, and the buffer is
+// refilled, or a NUL of the input, which takes its real transition.
+std::string CodeGenerator::tableMatcher() const {
+	std::string matcher = "\t\tyy_state = yy_start_state[" + startIndex() + "];\n";
+	matcher += R"(		for (;;) {
+			yy_next = YY_NEXT(yy_state, yy_ec[(unsigned char)*yy_p]);
+			if (yy_next == 0) {
+				if (*yy_p != '\0')
+					break;
+				if (yy_p == yy_buf + yy_buf_len) {
+					if (!yy_more_input(&yy_p YY_CALL_LAST_ARG))
+						break;
+					continue;
+				}
+				yy_next = yy_nul_trans[yy_state];
+				if (yy_next == 0)
+					break;
+			}
+			yy_state = yy_next;
+			++yy_p;
+)";
+	// without backing up the scan stops where it accepts, if anywhere
+	bool record = !_backup.empty();
+	if (record) {
+		matcher += R"(			if (yy_accept[yy_state]) {
+				yy_rule = yy_accept[yy_state] - 1;
+				yy_match_len = (size_t)(yy_p - yy_buf) - yy_cp;
+			}
+)";
+	}
+	if (hasSkipLoops()) {
+		matcher += R"(			if (yy_skip_state[yy_state] >= 0) {
+				yy_k = yy_skip(yy_p, (size_t)(yy_buf + yy_buf_len - yy_p), yy_skip_state[yy_state]);
+				yy_p += yy_k;
+)";
+		if (record) {
+			matcher += R"(				if (yy_k && yy_accept[yy_state])
+					yy_match_len = (size_t)(yy_p - yy_buf) - yy_cp;
+)";
+		}
+		matcher += "\t\t\t}\n";
+	}
+	matcher += "\t\t}\n";
+	if (!record) {
+		matcher += R"(		if (yy_accept[yy_state] && yy_p != yy_buf + yy_cp) {
+			yy_rule = yy_accept[yy_state] - 1;
+			yy_match_len = (size_t)(yy_p - yy_buf) - yy_cp;
+		}
+)";
+	}
+	return matcher;
+}
+
+// Every live state becomes a labeled block that records its rule when it
+// accepts, then switches on the next raw byte and jumps to the next block.
+// A scanner that never backs up records nothing on the way: an accepting
+// state leaves through an exit block of its own that records its rule.
+// The most frequent target of a state becomes the default branch. Start
+// states that accept are entered past their record so that no empty match
+// is ever taken, as in the table-driven loop. Byte 0 always gets its own
+// case, where the NUL sentinel at the end of the buffer is told apart from a
+// NUL of the input.
+std::string CodeGenerator::directMatcher() const {
+	size_t stateCount = _dfa.getStateCount();
+	std::vector<bool> targeted(stateCount, false);
+	for (size_t s = 1; s < stateCount; ++s) {
+		for (size_t c = 0; c < _dfa.getClassCount(); ++c) {
+			targeted[_dfa.getTransition(s, c)] = true;
+		}
+	}
+	std::vector<std::pair<size_t, bool>> entries = startEntries();
+	std::vector<bool> entered(stateCount, false);
+	for (auto [condition, atLineStart] : entries) {
+		entered[_dfa.getStartState(condition, atLineStart)] = true;
+	}
+
+	std::ostringstream out;
+	out << "\t\tswitch (" << startIndex() << ") {\n";
+	for (size_t i = 0; i < entries.size(); ++i) {
+		Dfa::StateId start = _dfa.getStartState(entries[i].first, entries[i].second);
+		out << "\t\tcase " << i << ":\n";
+		if (start == Dfa::DEAD_STATE) {
+			out << "\t\t\tgoto yy_matched;\n";
+		} else {
+			out << "\t\t\tgoto yy_in_" << start << ";\n";
+		}
+	}
+	out << "\t\tdefault:\n\t\t\tgoto yy_matched;\n\t\t}\n";
+
+	std::vector<size_t> bytesPerTarget(stateCount, 0);
+	std::vector<Dfa::StateId> targets;
+	bool record = !_backup.empty();
+	for (size_t s = 1; s < stateCount; ++s) {
+		bool accepting = _dfa.getAcceptRule(s) != Dfa::NO_RULE;
+		std::string exit = !record && accepting ? "yy_ex_" + std::to_string(s) : "yy_matched";
+		if (targeted[s]) {
+			out << "\tyy_st_" << s << ":\n";
+		}
+		if (record && accepting) {
+			out << "\t\tyy_rule = " << _dfa.getAcceptRule(s) << ";\n";
+			out << "\t\tyy_match_len = (size_t)(yy_p - yy_buf) - yy_cp;\n";
+		}
+		if (entered[s]) {
+			out << "\tyy_in_" << s << ":\n";
+		}
+		if (hasSkipLoops() && _skipIndex[s] >= 0) {
+			out << "\t\tyy_k = yy_skip(yy_p, (size_t)(yy_buf + yy_buf_len - yy_p), " << _skipIndex[s] << ");\n";
+			out << "\t\tif (yy_k) {\n";
+			out << "\t\t\tyy_p += yy_k;\n";
+			if (record && accepting) {
+				out << "\t\t\tyy_rule = " << _dfa.getAcceptRule(s) << ";\n";
+				out << "\t\t\tyy_match_len = (size_t)(yy_p - yy_buf) - yy_cp;\n";
+			}
+			out << "\t\t}\n";
+		}
+		out << "\tyy_re_" << s << ":\n";
+
+		// only the targets of this state are counted, so that the whole pass
+		// stays linear in the number of states
+		targets.clear();
+		for (int b = 1; b < 256; ++b) {
+			Dfa::StateId t = _dfa.getTransition(s, _dfa.getClass(static_cast<uint8_t>(b)));
+			if (bytesPerTarget[t]++ == 0) {
+				targets.push_back(t);
+			}
+		}
+		std::sort(targets.begin(), targets.end());
+		Dfa::StateId fallback = Dfa::DEAD_STATE;
+		for (Dfa::StateId t : targets) {
+			if (bytesPerTarget[t] > bytesPerTarget[fallback]) {
+				fallback = t;
+			}
+		}
+		for (Dfa::StateId t : targets) {
+			bytesPerTarget[t] = 0;
+		}
+
+		out << "\t\tswitch ((unsigned char)*yy_p) {\n";
+		out << "\t\tcase 0:\n";
+		out << "\t\t\tif (yy_p == yy_buf + yy_buf_len) {\n";
+		out << "\t\t\t\tif (yy_more_input(&yy_p YY_CALL_LAST_ARG))\n";
+		out << "\t\t\t\t\tgoto yy_re_" << s << ";\n";
+		out << "\t\t\t\tgoto " << exit << ";\n";
+		out << "\t\t\t}\n";
+		Dfa::StateId nulTarget = _dfa.getTransition(s, _dfa.getClass(0));
+		if (nulTarget == Dfa::DEAD_STATE) {
+			out << "\t\t\tgoto " << exit << ";\n";
+		} else {
+			out << "\t\t\t++yy_p;\n\t\t\tgoto yy_st_" << nulTarget << ";\n";
+		}
+		for (Dfa::StateId t : targets) {
+			if (t == fallback) {
+				continue;
+			}
+			int column = 0;
+			out << "\t\t";
+			for (int b = 1; b < 256; ++b) {
+				if (_dfa.getTransition(s, _dfa.getClass(static_cast<uint8_t>(b))) != t) {
+					continue;
+				}
+				if (column == 8) {
+					out << "\n\t\t";
+					column = 0;
+				}
+				out << (column ? " " : "") << "case " << b << ":";
+				++column;
+			}
+			out << "\n";
+			if (t == Dfa::DEAD_STATE) {
+				out << "\t\t\tgoto " << exit << ";\n";
+			} else {
+				out << "\t\t\t++yy_p;\n\t\t\tgoto yy_st_" << t << ";\n";
+			}
+		}
+		out << "\t\tdefault:\n";
+		if (fallback == Dfa::DEAD_STATE) {
+			out << "\t\t\tgoto " << exit << ";\n";
+		} else {
+			out << "\t\t\t++yy_p;\n\t\t\tgoto yy_st_" << fallback << ";\n";
+		}
+		out << "\t\t}\n";
+		if (exit != "yy_matched") {
+			out << "\t" << exit << ":\n";
+			// a start state is left without a match when nothing was read
+			if (entered[s]) {
+				out << "\t\tif (yy_p == yy_buf + yy_cp)\n\t\t\tgoto yy_matched;\n";
+			}
+			out << "\t\tyy_rule = " << _dfa.getAcceptRule(s) << ";\n";
+			out << "\t\tyy_match_len = (size_t)(yy_p - yy_buf) - yy_cp;\n";
+			out << "\t\tgoto yy_matched;\n";
+		}
+	}
+	out << "\tyy_matched:\n";
+	return out.str();
+}
+
+size_t CodeGenerator::getDirectCodeBytes() const {
+	return directMatcher().size();
+}
+
+bool CodeGenerator::generate(std::ostream &out, TableMode mode, LexFileParser::Content::ScannerStyle style) {
+	std::string matcher;
+	if (style == LexFileParser::Content::DIRECT_CODED) {
+		matcher = directMatcher();
+		if (matcher.size() > MAX_DIRECT_CODE_BYTES) {
+			std::cerr << "Warning: direct-coded scanner would take " << matcher.size()
+				<< " bytes, falling back to table-driven output" << std::endl;
+			style = LexFileParser::Content::TABLE_DRIVEN;
+		}
+	}
+	bool direct = (style == LexFileParser::Content::DIRECT_CODED);
+	if (!direct) {
+		if (!checkCapacity(mode)) {
+			return false;
+		}
+		matcher = tableMatcher();
+	}
+	emitPrologue(out);
+	if (!direct) {
+		emitTables(out, mode);
+	}
+	emitScanner(out, matcher, direct);
+	// the parallel scan only walks the DFA tables
+	if (!direct && _dfa.getFallbackCount() == 0) {
+		emitParallelScan(out);
+	}
+	emitEpilogue(out);
+	return static_cast<bool>(out);
+}
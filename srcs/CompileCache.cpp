@@ -0,0 +1,195 @@
+#include "CompileCache.hpp"
+#include "Dfa.hpp"
+#include "KeywordTable.hpp"
+#include "Nfa.hpp"
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+void CompileCache::Writer::put(uint64_t value) {
+	_data.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+void CompileCache::Writer::put(std::string_view text) {
+	put(static_cast<uint64_t>(text.size()));
+	_data.append(text);
+}
+
+void CompileCache::Writer::put(const std::vector<bool> &values) {
+	std::vector<uint8_t> bytes(values.begin(), values.end());
+	put(bytes);
+}
+
+const std::string &CompileCache::Writer::getData() const {
+	return _data;
+}
+
+CompileCache::Reader::Reader(std::string_view data) : _data(data) {}
+
+bool CompileCache::Reader::get(uint64_t &value) {
+	if (_data.size() - _position < sizeof(value)) {
+		return false;
+	}
+	std::memcpy(&value, _data.data() + _position, sizeof(value));
+	_position += sizeof(value);
+	return true;
+}
+
+bool CompileCache::Reader::get(std::string &text) {
+	uint64_t size;
+	if (!get(size) || size > _data.size() - _position) {
+		return false;
+	}
+	text.assign(_data.substr(_position, size));
+	_position += size;
+	return true;
+}
+
+bool CompileCache::Reader::get(std::vector<bool> &values) {
+	std::vector<uint8_t> bytes;
+	if (!get(bytes)) {
+		return false;
+	}
+	values.assign(bytes.begin(), bytes.end());
+	return true;
+}
+
+bool CompileCache::Reader::atEnd() const {
+	return _position == _data.size();
+}
+
+CompileCache::CompileCache(const std::string &directory) : _directory(directory) {}
+
+CompileCache::~CompileCache() {}
+
+bool CompileCache::isEnabled() const {
+	return !_directory.empty();
+}
+
+// The size, modification time and inode of the running executable: any
+// rebuild or reinstall of ft_lex changes it. Zero where /proc is missing,
+// which leaves the cache format alone to tell versions apart.
+static uint64_t executableStamp() {
+	struct stat st;
+	if (stat("/proc/self/exe", &st) != 0) {
+		return 0;
+	}
+	return static_cast<uint64_t>(st.st_size) * 1000003 ^ static_cast<uint64_t>(st.st_mtime) * 31 ^ static_cast<uint64_t>(st.st_ino);
+}
+
+void CompileCache::setKey(const LexFileParser::Content &content, const std::string &options) {
+	Writer key;
+	key.put(FORMAT_VERSION);
+	key.put(executableStamp());
+	key.put(options);
+	for (size_t limit : { content.positionsSize, content.statesSize, content.transitionsSize, content.parseTreeSize,
+		content.packedCharacterClassesSize, content.outputArraySize }) {
+		key.put(static_cast<uint64_t>(limit));
+	}
+	key.put(static_cast<uint64_t>(content.substitutions.size()));
+	for (const auto &[name, value] : content.substitutions) {
+		key.put(name);
+		key.put(value);
+	}
+	key.put(static_cast<uint64_t>(content.startConditions.size()));
+	for (const auto &condition : content.startConditions) {
+		key.put(condition.name);
+		key.put(static_cast<uint64_t>(condition.inclusive));
+	}
+	key.put(static_cast<uint64_t>(content.rules.size()));
+	for (const auto &rule : content.rules) {
+		key.put(rule.pattern);
+		key.put(static_cast<uint64_t>(rule.lineStart));
+		key.put(static_cast<uint64_t>(rule.startConditions.size()));
+		for (std::string_view condition : rule.startConditions) {
+			key.put(condition);
+		}
+	}
+	_key = key.getData();
+	// FNV-1a
+	_hash = 14695981039346656037ULL;
+	for (char c : _key) {
+		_hash = (_hash ^ static_cast<uint8_t>(c)) * 1099511628211ULL;
+	}
+}
+
+std::string CompileCache::getEntryPath() const {
+	char name[17];
+	std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(_hash));
+	return _directory + "/" + name + std::string(EXTENSION);
+}
+
+bool CompileCache::load(Nfa &nfa, Dfa &dfa, KeywordTable &keywords, size_t &statesBeforeMinimization) const {
+	std::ifstream file(getEntryPath(), std::ios::binary);
+	if (!file.is_open()) {
+		return false;
+	}
+	std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	if (!data.starts_with(MAGIC)) {
+		return false;
+	}
+	Reader in(std::string_view(data).substr(MAGIC.size()));
+	std::string key;
+	uint64_t states;
+	if (!in.get(key) || key != _key || !in.get(states)) {
+		return false;
+	}
+	if (!keywords.load(in) || !nfa.load(in) || !dfa.load(in) || !in.atEnd()) {
+		// a damaged entry: the caller builds into the same objects
+		keywords = KeywordTable();
+		nfa = Nfa();
+		dfa = Dfa();
+		return false;
+	}
+	statesBeforeMinimization = states;
+	return true;
+}
+
+void CompileCache::store(const Nfa &nfa, const Dfa &dfa, const KeywordTable &keywords, size_t statesBeforeMinimization) const {
+	Writer out;
+	out.put(_key);
+	out.put(static_cast<uint64_t>(statesBeforeMinimization));
+	keywords.save(out);
+	nfa.save(out);
+	dfa.save(out);
+
+	std::error_code error;
+	std::filesystem::create_directories(_directory, error);
+	// written aside and renamed, so that concurrent builds never read half
+	// an entry
+	std::string path = getEntryPath();
+	std::string temporary = path + ".tmp" + std::to_string(getpid());
+	std::ofstream file(temporary, std::ios::binary);
+	file << MAGIC << out.getData();
+	file.close();
+	if (!file || std::rename(temporary.c_str(), path.c_str()) != 0) {
+		std::remove(temporary.c_str());
+		std::cerr << "Warning: Could not write the compile cache entry " << path << std::endl;
+	}
+}
+
+bool CompileCache::clear() const {
+	std::error_code error;
+	if (!std::filesystem::exists(_directory, error)) {
+		return true;
+	}
+	for (const auto &entry : std::filesystem::directory_iterator(_directory, error)) {
+		if (entry.path().extension() == EXTENSION) {
+			std::filesystem::remove(entry.path(), error);
+			if (error) {
+				break;
+			}
+		}
+	}
+	if (error) {
+		std::cerr << "Error: Could not clear the compile cache in " << _directory << ": " << error.message() << std::endl;
+		return false;
+	}
+	return true;
+}
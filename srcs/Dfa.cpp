@@ -0,0 +1,534 @@
+#include "Dfa.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+Dfa::Dfa() {}
+
+Dfa::~Dfa() {}
+
+size_t Dfa::SetHash::operator()(StateId id) const {
+	uint64_t h = 0xCBF29CE484222325ULL;
+	for (uint32_t i = dfa->_setOffsets[id]; i < dfa->_setOffsets[id + 1]; ++i) {
+		h = (h ^ dfa->_setData[i]) * 0x100000001B3ULL;
+	}
+	return static_cast<size_t>(h ^ (h >> 32));
+}
+
+bool Dfa::SetEqual::operator()(StateId a, StateId b) const {
+	uint32_t aBegin = dfa->_setOffsets[a];
+	uint32_t aEnd = dfa->_setOffsets[a + 1];
+	uint32_t bBegin = dfa->_setOffsets[b];
+	uint32_t bEnd = dfa->_setOffsets[b + 1];
+	if (aEnd - aBegin != bEnd - bBegin) {
+		return false;
+	}
+	return std::equal(dfa->_setData.begin() + aBegin, dfa->_setData.begin() + aEnd, dfa->_setData.begin() + bBegin);
+}
+
+// Every character set labelling an edge must be a union of classes. Starting
+// from one class of all bytes, each set splits the classes it cuts into their
+// intersection with it and the rest, a few word operations per class.
+size_t Dfa::computeClasses(const Nfa &nfa, std::array<uint16_t, 256> &classMap, size_t &characterSetCount) {
+	std::vector<bool> used(nfa.getSetCount(), false);
+	characterSetCount = 0;
+	std::vector<CharSet> classes = { CharSet::all() };
+	for (Nfa::StateId s = 0; s < nfa.getStateCount(); ++s) {
+		for (const auto &edge : nfa.getSetEdges(s)) {
+			if (used[edge.set]) {
+				continue;
+			}
+			used[edge.set] = true;
+			++characterSetCount;
+			const CharSet &set = nfa.getSet(edge.set);
+			size_t classCount = classes.size();
+			for (size_t k = 0; k < classCount; ++k) {
+				CharSet inside = classes[k] & set;
+				if (!inside.empty() && inside != classes[k]) {
+					classes.push_back(classes[k] - set);
+					classes[k] = inside;
+				}
+			}
+		}
+	}
+
+	// renumber by first member so that class ids grow with their lowest byte
+	std::sort(classes.begin(), classes.end(), [](const CharSet &a, const CharSet &b) { return a.first() < b.first(); });
+	for (size_t k = 0; k < classes.size(); ++k) {
+		classes[k].forEachRange([&](uint8_t lo, uint8_t hi) {
+			for (int c = lo; c <= hi; ++c) {
+				classMap[c] = static_cast<uint16_t>(k);
+			}
+		});
+	}
+	return classes.size();
+}
+
+void Dfa::closure(const Nfa &nfa, std::vector<Nfa::StateId> &states, std::vector<uint32_t> &marks, uint32_t generation) {
+	size_t kept = 0;
+	for (size_t i = 0; i < states.size(); ++i) {
+		if (marks[states[i]] != generation) {
+			marks[states[i]] = generation;
+			states[kept++] = states[i];
+		}
+	}
+	states.resize(kept);
+	for (size_t i = 0; i < states.size(); ++i) {
+		for (Nfa::StateId target : nfa.getEpsilonEdges(states[i])) {
+			if (marks[target] != generation) {
+				marks[target] = generation;
+				states.push_back(target);
+			}
+		}
+	}
+	// only states that consume input or accept tell two subsets apart
+	kept = 0;
+	for (size_t i = 0; i < states.size(); ++i) {
+		if (!nfa.getSetEdges(states[i]).empty() || nfa.getAcceptRule(states[i]) != Nfa::NO_RULE) {
+			states[kept++] = states[i];
+		}
+	}
+	states.resize(kept);
+	std::sort(states.begin(), states.end());
+}
+
+Dfa::StateId Dfa::intern(std::unordered_set<StateId, SetHash, SetEqual> &sets, const Nfa &nfa, const std::vector<Nfa::StateId> &states) {
+	StateId candidate = static_cast<StateId>(_acceptRule.size());
+	_setData.insert(_setData.end(), states.begin(), states.end());
+	_setOffsets.push_back(static_cast<uint32_t>(_setData.size()));
+
+	auto it = sets.find(candidate);
+	if (it != sets.end()) {
+		_setOffsets.pop_back();
+		_setData.resize(_setOffsets.back());
+		return *it;
+	}
+	sets.insert(candidate);
+
+	int32_t rule = NO_RULE;
+	for (Nfa::StateId s : states) {
+		int32_t accept = nfa.getAcceptRule(s);
+		// a rule left out may still end on a shared prefix state
+		if (accept != Nfa::NO_RULE && !_fallbackRules[accept] && (rule == NO_RULE || accept < rule)) {
+			rule = accept;
+		}
+	}
+	_acceptRule.push_back(rule);
+	_transitions.resize(_transitions.size() + _classCount, DEAD_STATE);
+	return candidate;
+}
+
+void Dfa::setBudget(size_t states, size_t bytes) {
+	_stateBudget = states;
+	_memoryBudget = bytes;
+}
+
+bool Dfa::build(const Nfa &nfa, const LexFileParser::Content &content) {
+	_classCount = computeClasses(nfa, _classMap, _characterSetCount);
+	if (_characterSetCount > content.packedCharacterClassesSize) {
+		std::cerr << "Error: " << _characterSetCount << " character classes exceed the %k limit of " << content.packedCharacterClassesSize << std::endl;
+		return false;
+	}
+
+	std::vector<uint32_t> ruleOf(nfa.getStateCount(), UINT32_MAX);
+	for (size_t r = 0; r < nfa.getRuleCount(); ++r) {
+		auto [first, last] = nfa.getRuleStates(r);
+		std::fill(ruleOf.begin() + first, ruleOf.begin() + last, static_cast<uint32_t>(r));
+	}
+	_fallbackRules.assign(nfa.getRuleCount(), false);
+	// every retry leaves one more rule out, so there are at most ruleCount
+	// of them, each bounded by the budget
+	while (!construct(nfa, ruleOf)) {
+		size_t rule = findExplodingRule(ruleOf);
+		if (rule == SIZE_MAX) {
+			std::cerr << "Error: The DFA budget of " << _stateBudget << " states and " << _memoryBudget
+				<< " bytes is too small for the start states" << std::endl;
+			return false;
+		}
+		warnFallback(content, rule);
+		_fallbackRules[rule] = true;
+	}
+	return true;
+}
+
+void Dfa::warnFallback(const LexFileParser::Content &content, size_t rule) const {
+	std::cerr << "Warning: Rule at line " << content.rules[rule].line << " (" << content.rules[rule].pattern
+		<< ") makes the DFA exceed its budget of " << _stateBudget << " states and " << _memoryBudget
+		<< " bytes; it will be matched by NFA simulation" << std::endl;
+}
+
+void Dfa::reportFallbackRules(const LexFileParser::Content &content) const {
+	for (size_t r = 0; r < _fallbackRules.size(); ++r) {
+		if (_fallbackRules[r]) {
+			warnFallback(content, r);
+		}
+	}
+}
+
+bool Dfa::construct(const Nfa &nfa, const std::vector<uint32_t> &ruleOf) {
+	_transitions.clear();
+	_acceptRule.clear();
+	_startStates.clear();
+	_setData.clear();
+
+	// the classes making up each character set, found by testing one byte
+	// of every class
+	std::vector<uint8_t> representative(_classCount, 0);
+	for (int c = 255; c >= 0; --c) {
+		representative[_classMap[c]] = static_cast<uint8_t>(c);
+	}
+	std::vector<uint32_t> classOffsets(nfa.getSetCount() + 1, 0);
+	std::vector<uint16_t> classesOf;
+	for (CharSetTable::SetId id = 0; id < nfa.getSetCount(); ++id) {
+		const CharSet &set = nfa.getSet(id);
+		for (size_t k = 0; k < _classCount; ++k) {
+			if (set.contains(representative[k])) {
+				classesOf.push_back(static_cast<uint16_t>(k));
+			}
+		}
+		classOffsets[id + 1] = static_cast<uint32_t>(classesOf.size());
+	}
+
+	_setOffsets = { 0 };
+	std::unordered_set<StateId, SetHash, SetEqual> sets(1024, SetHash{ this }, SetEqual{ this });
+	std::vector<uint32_t> marks(nfa.getStateCount(), 0);
+	uint32_t generation = 0;
+	std::vector<Nfa::StateId> states;
+
+	// the states of the rules left out are dropped from every subset; the
+	// shared prefix states belong to no rule and stay
+	bool leavingOut = std::find(_fallbackRules.begin(), _fallbackRules.end(), true) != _fallbackRules.end();
+	auto leaveOut = [&](std::vector<Nfa::StateId> &subset) {
+		if (leavingOut) {
+			std::erase_if(subset, [&](Nfa::StateId state) { return ruleOf[state] != UINT32_MAX && _fallbackRules[ruleOf[state]]; });
+		}
+	};
+
+	intern(sets, nfa, states);
+	// without anchored rules both start states of a condition have the same
+	// closure and intern to the same state
+	for (size_t c = 0; c < nfa.getStartStateCount(); ++c) {
+		for (bool atLineStart : { false, true }) {
+			states.assign(1, nfa.getStartState(c, atLineStart));
+			closure(nfa, states, marks, ++generation);
+			leaveOut(states);
+			_startStates.push_back(intern(sets, nfa, states));
+		}
+	}
+
+	std::vector<std::vector<Nfa::StateId>> buckets(_classCount);
+	std::vector<uint16_t> touched;
+	for (StateId current = 1; current < _acceptRule.size(); ++current) {
+		touched.clear();
+		for (uint32_t i = _setOffsets[current]; i < _setOffsets[current + 1]; ++i) {
+			for (const auto &edge : nfa.getSetEdges(_setData[i])) {
+				for (uint32_t j = classOffsets[edge.set]; j < classOffsets[edge.set + 1]; ++j) {
+					uint16_t k = classesOf[j];
+					if (buckets[k].empty()) {
+						touched.push_back(k);
+					}
+					buckets[k].push_back(edge.target);
+				}
+			}
+		}
+		for (uint16_t k : touched) {
+			closure(nfa, buckets[k], marks, ++generation);
+			leaveOut(buckets[k]);
+			StateId target = intern(sets, nfa, buckets[k]);
+			_transitions[current * _classCount + k] = target;
+			buckets[k].clear();
+		}
+		if (_acceptRule.size() > _stateBudget || bytesUsed() + sets.size() * SET_ENTRY_BYTES > _memoryBudget) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// The exploding rule is the one whose own states appear in the most distinct
+// combinations across the subsets: a well-behaved rule only contributes a few
+// (one per position it can be in), whatever the other rules do. A subset is
+// sorted and the states of a rule are contiguous, so each rule's part of it
+// is a contiguous slice, compared by hash.
+size_t Dfa::findExplodingRule(const std::vector<uint32_t> &ruleOf) const {
+	std::vector<std::unordered_set<uint64_t>> slices(_fallbackRules.size());
+	for (size_t state = 1; state + 1 < _setOffsets.size(); ++state) {
+		uint32_t i = _setOffsets[state];
+		while (i < _setOffsets[state + 1]) {
+			uint32_t rule = ruleOf[_setData[i]];
+			uint64_t h = 0xCBF29CE484222325ULL;
+			for (; i < _setOffsets[state + 1] && ruleOf[_setData[i]] == rule; ++i) {
+				h = (h ^ _setData[i]) * 0x100000001B3ULL;
+			}
+			if (rule != UINT32_MAX) {
+				slices[rule].insert(h);
+			}
+		}
+	}
+	size_t worst = SIZE_MAX;
+	for (size_t r = 0; r < slices.size(); ++r) {
+		if (!_fallbackRules[r] && !slices[r].empty() && (worst == SIZE_MAX || slices[r].size() > slices[worst].size())) {
+			worst = r;
+		}
+	}
+	return worst;
+}
+
+// Accepting states start in one block per rule, so states accepting different
+// rules are never merged and rule priority survives. Splitters are whole
+// blocks processed against every class; when a block that is not pending is
+// split only its smaller half is queued, which gives O(n * k * log n).
+size_t Dfa::minimize() {
+	size_t stateCount = _acceptRule.size();
+	size_t classCount = _classCount;
+	if (stateCount == 0) {
+		return 0;
+	}
+
+	// inverse transitions in CSR form, indexed by target * classCount + class
+	std::vector<uint32_t> inverseOffsets(stateCount * classCount + 1, 0);
+	for (size_t s = 0; s < stateCount; ++s) {
+		for (size_t c = 0; c < classCount; ++c) {
+			++inverseOffsets[_transitions[s * classCount + c] * classCount + c + 1];
+		}
+	}
+	for (size_t i = 0; i + 1 < inverseOffsets.size(); ++i) {
+		inverseOffsets[i + 1] += inverseOffsets[i];
+	}
+	std::vector<StateId> inverse(stateCount * classCount);
+	{
+		std::vector<uint32_t> cursor(inverseOffsets.begin(), inverseOffsets.end() - 1);
+		for (size_t s = 0; s < stateCount; ++s) {
+			for (size_t c = 0; c < classCount; ++c) {
+				inverse[cursor[_transitions[s * classCount + c] * classCount + c]++] = static_cast<StateId>(s);
+			}
+		}
+	}
+
+	// refinable partition: the states of block b are elements[start[b] .. end[b])
+	std::vector<StateId> elements(stateCount);
+	std::vector<uint32_t> location(stateCount);
+	std::vector<uint32_t> blockOf(stateCount);
+	std::vector<uint32_t> blockStart;
+	std::vector<uint32_t> blockEnd;
+	std::vector<uint32_t> marked;
+	std::vector<bool> pending;
+	std::vector<uint32_t> worklist;
+
+	for (size_t s = 0; s < stateCount; ++s) {
+		elements[s] = static_cast<StateId>(s);
+	}
+	std::stable_sort(elements.begin(), elements.end(), [this](StateId a, StateId b) {
+		return _acceptRule[a] < _acceptRule[b];
+	});
+	for (size_t i = 0; i < stateCount; ++i) {
+		if (i == 0 || _acceptRule[elements[i]] != _acceptRule[elements[i - 1]]) {
+			if (i != 0) {
+				blockEnd.push_back(static_cast<uint32_t>(i));
+			}
+			blockStart.push_back(static_cast<uint32_t>(i));
+		}
+		location[elements[i]] = static_cast<uint32_t>(i);
+		blockOf[elements[i]] = static_cast<uint32_t>(blockStart.size() - 1);
+	}
+	blockEnd.push_back(static_cast<uint32_t>(stateCount));
+	marked.assign(blockStart.size(), 0);
+	pending.assign(blockStart.size(), true);
+	for (uint32_t b = 0; b < blockStart.size(); ++b) {
+		worklist.push_back(b);
+	}
+
+	std::vector<StateId> splitter;
+	std::vector<uint32_t> touched;
+	while (!worklist.empty()) {
+		uint32_t a = worklist.back();
+		worklist.pop_back();
+		pending[a] = false;
+		splitter.assign(elements.begin() + blockStart[a], elements.begin() + blockEnd[a]);
+
+		for (size_t c = 0; c < classCount; ++c) {
+			touched.clear();
+			for (StateId target : splitter) {
+				size_t key = target * classCount + c;
+				for (uint32_t i = inverseOffsets[key]; i < inverseOffsets[key + 1]; ++i) {
+					StateId p = inverse[i];
+					uint32_t b = blockOf[p];
+					uint32_t firstUnmarked = blockStart[b] + marked[b];
+					if (location[p] < firstUnmarked) {
+						continue;
+					}
+					StateId other = elements[firstUnmarked];
+					std::swap(elements[location[p]], elements[firstUnmarked]);
+					location[other] = location[p];
+					location[p] = firstUnmarked;
+					if (marked[b]++ == 0) {
+						touched.push_back(b);
+					}
+				}
+			}
+			for (uint32_t b : touched) {
+				uint32_t count = marked[b];
+				marked[b] = 0;
+				if (count == blockEnd[b] - blockStart[b]) {
+					continue;
+				}
+				uint32_t fresh = static_cast<uint32_t>(blockStart.size());
+				blockStart.push_back(blockStart[b]);
+				blockEnd.push_back(blockStart[b] + count);
+				marked.push_back(0);
+				blockStart[b] += count;
+				for (uint32_t i = blockStart[fresh]; i < blockEnd[fresh]; ++i) {
+					blockOf[elements[i]] = fresh;
+				}
+				if (pending[b]) {
+					pending.push_back(true);
+					worklist.push_back(fresh);
+				} else if (count <= blockEnd[b] - blockStart[b]) {
+					pending.push_back(true);
+					worklist.push_back(fresh);
+				} else {
+					pending.push_back(false);
+					pending[b] = true;
+					worklist.push_back(b);
+				}
+			}
+		}
+	}
+
+	// the dead state keeps id 0, other blocks are numbered by their lowest state
+	size_t blockCount = blockStart.size();
+	std::vector<StateId> newId(blockCount, UINT32_MAX);
+	std::vector<StateId> representative;
+	newId[blockOf[DEAD_STATE]] = DEAD_STATE;
+	representative.push_back(DEAD_STATE);
+	for (size_t s = 0; s < stateCount; ++s) {
+		if (newId[blockOf[s]] == UINT32_MAX) {
+			newId[blockOf[s]] = static_cast<StateId>(representative.size());
+			representative.push_back(static_cast<StateId>(s));
+		}
+	}
+
+	std::vector<StateId> transitions(representative.size() * classCount);
+	std::vector<int32_t> acceptRule(representative.size());
+	for (size_t n = 0; n < representative.size(); ++n) {
+		StateId old = representative[n];
+		acceptRule[n] = _acceptRule[old];
+		for (size_t c = 0; c < classCount; ++c) {
+			transitions[n * classCount + c] = newId[blockOf[_transitions[old * classCount + c]]];
+		}
+	}
+	for (auto &start : _startStates) {
+		start = newId[blockOf[start]];
+	}
+	_transitions.swap(transitions);
+	_acceptRule.swap(acceptRule);
+	std::vector<Nfa::StateId>().swap(_setData);
+	std::vector<uint32_t>().swap(_setOffsets);
+	return stateCount;
+}
+
+size_t Dfa::getStateCount() const {
+	return _acceptRule.size();
+}
+
+size_t Dfa::getClassCount() const {
+	return _classCount;
+}
+
+size_t Dfa::getCharacterSetCount() const {
+	return _characterSetCount;
+}
+
+const std::vector<bool> &Dfa::getFallbackRules() const {
+	return _fallbackRules;
+}
+
+size_t Dfa::getFallbackCount() const {
+	return static_cast<size_t>(std::count(_fallbackRules.begin(), _fallbackRules.end(), true));
+}
+
+size_t Dfa::bytesUsed() const {
+	return _transitions.capacity() * sizeof(StateId)
+		+ _acceptRule.capacity() * sizeof(int32_t)
+		+ _setData.capacity() * sizeof(Nfa::StateId)
+		+ _setOffsets.capacity() * sizeof(uint32_t);
+}
+
+uint16_t Dfa::getClass(uint8_t byte) const {
+	return _classMap[byte];
+}
+
+const std::array<uint16_t, 256> &Dfa::getClassMap() const {
+	return _classMap;
+}
+
+Dfa::StateId Dfa::getTransition(StateId state, uint16_t byteClass) const {
+	return _transitions[state * _classCount + byteClass];
+}
+
+int32_t Dfa::getAcceptRule(StateId state) const {
+	return _acceptRule[state];
+}
+
+Dfa::StateId Dfa::getStartState(size_t condition, bool atLineStart) const {
+	return _startStates[condition * 2 + atLineStart];
+}
+
+size_t Dfa::getStartStateCount() const {
+	return _startStates.size() / 2;
+}
+
+// The part of a minimal automaton reachable from some of its states is still
+// minimal, so this is exactly what separate automata would take.
+size_t Dfa::getSeparateStateCount() const {
+	std::vector<size_t> marks(getStateCount(), SIZE_MAX);
+	std::vector<StateId> reached;
+	size_t total = 0;
+	for (size_t c = 0; c < getStartStateCount(); ++c) {
+		reached.clear();
+		for (bool atLineStart : { false, true }) {
+			StateId start = getStartState(c, atLineStart);
+			if (start != DEAD_STATE && marks[start] != c) {
+				marks[start] = c;
+				reached.push_back(start);
+			}
+		}
+		for (size_t i = 0; i < reached.size(); ++i) {
+			for (size_t k = 0; k < _classCount; ++k) {
+				StateId target = getTransition(reached[i], static_cast<uint16_t>(k));
+				if (target != DEAD_STATE && marks[target] != c) {
+					marks[target] = c;
+					reached.push_back(target);
+				}
+			}
+		}
+		total += reached.size() + 1;
+	}
+	return total;
+}
+
+void Dfa::save(CompileCache::Writer &out) const {
+	out.put(_fallbackRules);
+	out.put(std::vector<uint16_t>(_classMap.begin(), _classMap.end()));
+	out.put(static_cast<uint64_t>(_classCount));
+	out.put(static_cast<uint64_t>(_characterSetCount));
+	out.put(_transitions);
+	out.put(_acceptRule);
+	out.put(_startStates);
+}
+
+bool Dfa::load(CompileCache::Reader &in) {
+	std::vector<uint16_t> classMap;
+	uint64_t classCount, characterSetCount;
+	if (!in.get(_fallbackRules) || !in.get(classMap) || classMap.size() != _classMap.size() || !in.get(classCount)
+		|| !in.get(characterSetCount) || !in.get(_transitions) || !in.get(_acceptRule) || !in.get(_startStates)) {
+		return false;
+	}
+	std::copy(classMap.begin(), classMap.end(), _classMap.begin());
+	_classCount = classCount;
+	_characterSetCount = characterSetCount;
+	_setData.clear();
+	_setOffsets.clear();
+	return _transitions.size() == _acceptRule.size() * _classCount && _startStates.size() % 2 == 0;
+}
@@ -0,0 +1,291 @@
+#include "GlushkovMatcher.hpp"
+#include "RegexArena.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+GlushkovMatcher::GlushkovMatcher() {}
+
+GlushkovMatcher::~GlushkovMatcher() {}
+
+// the interpreter scans from INITIAL only, so only its rules get positions
+static bool isActiveInInitial(const LexFileParser::Content &content, size_t rule) {
+	const auto &conditions = content.rules[rule].startConditions;
+	if (conditions.empty()) {
+		return content.startConditions[0].inclusive;
+	}
+	return std::find(conditions.begin(), conditions.end(), content.startConditions[0].name) != conditions.end();
+}
+
+static bool hasLineStartRules(const LexFileParser::Content &content, size_t ruleCount) {
+	for (size_t r = 0; r < ruleCount; ++r) {
+		if (content.rules[r].lineStart && isActiveInInitial(content, r)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static void unite(std::array<uint64_t, GlushkovMatcher::MAX_WORDS> &into, const std::array<uint64_t, GlushkovMatcher::MAX_WORDS> &bits) {
+	for (size_t w = 0; w < into.size(); ++w) {
+		into[w] |= bits[w];
+	}
+}
+
+// Saturates just above MAX_POSITIONS so that counted repetitions cannot
+// overflow; shared subtrees are counted once per occurrence, as they get
+// positions of their own.
+size_t GlushkovMatcher::countNode(const RegexArena &arena, RegexParser::NodeId id, std::vector<size_t> &memo) {
+	if (memo[id] != SIZE_MAX) {
+		return memo[id];
+	}
+	const RegexParser::RegexNode &node = arena.getNode(id);
+	size_t count = 0;
+	switch (node.type) {
+		case RegexParser::ATOM: {
+			const auto &atom = std::get<RegexParser::AtomNode>(node.data);
+			count = atom.type == RegexParser::STRING ? atom.valueLength : 1;
+			break;
+		}
+		case RegexParser::CONCATENATION: {
+			const auto &concat = std::get<RegexParser::ConcatenationNode>(node.data);
+			count = countNode(arena, concat.left, memo) + countNode(arena, concat.right, memo);
+			break;
+		}
+		case RegexParser::ALTERNATION: {
+			const auto &alt = std::get<RegexParser::AlternationNode>(node.data);
+			count = countNode(arena, alt.left, memo) + countNode(arena, alt.right, memo);
+			break;
+		}
+		case RegexParser::QUANTIFIER: {
+			const auto &quantifier = std::get<RegexParser::QuantifierNode>(node.data);
+			count = countNode(arena, quantifier.node, memo);
+			if (quantifier.quantifierType == RegexParser::RANGE) {
+				size_t copies = static_cast<size_t>(quantifier.max == RegexParser::UNBOUNDED ? std::max(quantifier.min, 1) : quantifier.max);
+				count = copies != 0 && count > MAX_POSITIONS / copies ? MAX_POSITIONS + 1 : count * copies;
+			}
+			break;
+		}
+	}
+	memo[id] = std::min(count, MAX_POSITIONS + 1);
+	return memo[id];
+}
+
+// counts the initial positions too
+size_t GlushkovMatcher::countPositions(const LexFileParser::Content &content, const std::vector<RegexParser::NodeId> &roots, const RegexArena &arena) const {
+	std::vector<size_t> memo(arena.size(), SIZE_MAX);
+	size_t count = 1 + hasLineStartRules(content, roots.size());
+	for (size_t r = 0; r < roots.size() && count <= MAX_POSITIONS; ++r) {
+		if (isActiveInInitial(content, r)) {
+			count += countNode(arena, roots[r], memo);
+		}
+	}
+	return std::min(count, MAX_POSITIONS + 1);
+}
+
+size_t GlushkovMatcher::newPosition(const CharSet &members) {
+	if (_followOf.size() >= MAX_POSITIONS) {
+		throw std::runtime_error("Too many positions for the bit-parallel engine");
+	}
+	_followOf.push_back(Bits{});
+	_bytesOf.push_back(members);
+	return _followOf.size() - 1;
+}
+
+void GlushkovMatcher::addFollow(const Bits &from, const Bits &to) {
+	for (size_t w = 0; w < MAX_WORDS; ++w) {
+		uint64_t bits = from[w];
+		while (bits != 0) {
+			unite(_followOf[w * 64 + __builtin_ctzll(bits)], to);
+			bits &= bits - 1;
+		}
+	}
+}
+
+static void setBit(std::array<uint64_t, GlushkovMatcher::MAX_WORDS> &bits, size_t position) {
+	bits[position >> 6] |= 1ULL << (position & 63);
+}
+
+GlushkovMatcher::Info GlushkovMatcher::buildAtom(const RegexParser::AtomNode &atom) {
+	Info info{ {}, {}, false };
+	if (atom.type == RegexParser::STRING) {
+		std::string_view value = _arena->getValue(atom);
+		info.nullable = value.empty();
+		size_t previous = SIZE_MAX;
+		for (char ch : value) {
+			size_t position = newPosition(CharSet::single(static_cast<uint8_t>(ch)));
+			if (previous == SIZE_MAX) {
+				setBit(info.first, position);
+			} else {
+				setBit(_followOf[previous], position);
+			}
+			previous = position;
+		}
+		if (previous != SIZE_MAX) {
+			setBit(info.last, previous);
+		}
+		return info;
+	}
+	size_t position = newPosition(_arena->getSet(atom.set));
+	setBit(info.first, position);
+	setBit(info.last, position);
+	return info;
+}
+
+// A counted repetition gets fresh positions for each copy: min mandatory
+// copies followed by max - min optional ones, as the NFA lowers it. {m,}
+// loops on its last copy.
+GlushkovMatcher::Info GlushkovMatcher::buildQuantifier(const RegexParser::QuantifierNode &quantifier) {
+	if (quantifier.quantifierType != RegexParser::RANGE) {
+		Info info = buildNode(quantifier.node);
+		if (quantifier.quantifierType == RegexParser::STAR || quantifier.quantifierType == RegexParser::PLUS) {
+			addFollow(info.last, info.first);
+		}
+		if (quantifier.quantifierType == RegexParser::STAR || quantifier.quantifierType == RegexParser::OPTIONAL) {
+			info.nullable = true;
+		}
+		return info;
+	}
+	bool unbounded = quantifier.max == RegexParser::UNBOUNDED;
+	int copies = unbounded ? std::max(quantifier.min, 1) : quantifier.max;
+	Info result{ {}, {}, true };
+	for (int i = 0; i < copies; ++i) {
+		Info copy = buildNode(quantifier.node);
+		if (unbounded && i == copies - 1) {
+			addFollow(copy.last, copy.first);
+		}
+		if (i >= quantifier.min) {
+			copy.nullable = true;
+		}
+		addFollow(result.last, copy.first);
+		if (result.nullable) {
+			unite(result.first, copy.first);
+		}
+		if (!copy.nullable) {
+			result.last = Bits{};
+		}
+		unite(result.last, copy.last);
+		result.nullable = result.nullable && copy.nullable;
+	}
+	return result;
+}
+
+GlushkovMatcher::Info GlushkovMatcher::buildNode(RegexParser::NodeId id) {
+	const RegexParser::RegexNode &node = _arena->getNode(id);
+	switch (node.type) {
+		case RegexParser::ATOM:
+			return buildAtom(std::get<RegexParser::AtomNode>(node.data));
+		case RegexParser::CONCATENATION: {
+			const auto &concat = std::get<RegexParser::ConcatenationNode>(node.data);
+			Info left = buildNode(concat.left);
+			Info right = buildNode(concat.right);
+			addFollow(left.last, right.first);
+			Info info{ left.first, right.last, left.nullable && right.nullable };
+			if (left.nullable) {
+				unite(info.first, right.first);
+			}
+			if (right.nullable) {
+				unite(info.last, left.last);
+			}
+			return info;
+		}
+		case RegexParser::ALTERNATION: {
+			const auto &alt = std::get<RegexParser::AlternationNode>(node.data);
+			Info left = buildNode(alt.left);
+			Info right = buildNode(alt.right);
+			unite(left.first, right.first);
+			unite(left.last, right.last);
+			left.nullable = left.nullable || right.nullable;
+			return left;
+		}
+		case RegexParser::QUANTIFIER:
+			return buildQuantifier(std::get<RegexParser::QuantifierNode>(node.data));
+	}
+	throw std::runtime_error("Unknown regex node type");
+}
+
+// follow(live) is the union of the follow sets of the live positions. It is
+// tabulated per byte of the live set: _follow[block][v] is the union over the
+// bits of v, built from the entry with the lowest bit of v cleared.
+void GlushkovMatcher::buildTables() {
+	size_t positions = _followOf.size();
+	_words = (positions + 63) / 64;
+	_blocks = (positions + 7) / 8;
+	_follow.assign(_blocks * 256 * _words, 0);
+	for (size_t block = 0; block < _blocks; ++block) {
+		for (size_t v = 1; v < 256; ++v) {
+			size_t position = block * 8 + static_cast<size_t>(__builtin_ctz(static_cast<unsigned>(v)));
+			uint64_t *entry = &_follow[(block * 256 + v) * _words];
+			const uint64_t *rest = &_follow[(block * 256 + (v & (v - 1))) * _words];
+			for (size_t w = 0; w < _words; ++w) {
+				entry[w] = rest[w] | (position < positions ? _followOf[position][w] : 0);
+			}
+		}
+	}
+	_positionsOf.assign(256 * _words, 0);
+	for (size_t position = 1; position < positions; ++position) {
+		_bytesOf[position].forEachRange([&](uint8_t lo, uint8_t hi) {
+			for (int byte = lo; byte <= hi; ++byte) {
+				_positionsOf[byte * _words + (position >> 6)] |= 1ULL << (position & 63);
+			}
+		});
+	}
+	std::vector<CharSet>().swap(_bytesOf);
+}
+
+bool GlushkovMatcher::build(const LexFileParser::Content &content, const std::vector<RegexParser::NodeId> &roots, const RegexArena &arena) {
+	if (countPositions(content, roots, arena) > MAX_POSITIONS) {
+		return false;
+	}
+	_arena = &arena;
+	_lineStart = hasLineStartRules(content, roots.size());
+	_followOf.clear();
+	_bytesOf.clear();
+	newPosition(CharSet());
+	if (_lineStart) {
+		newPosition(CharSet());
+	}
+
+	std::vector<std::pair<Bits, int32_t>> accepting;
+	for (size_t r = 0; r < roots.size(); ++r) {
+		if (!isActiveInInitial(content, r)) {
+			continue;
+		}
+		Info info = buildNode(roots[r]);
+		if (!content.rules[r].lineStart) {
+			unite(_followOf[0], info.first);
+		}
+		if (_lineStart) {
+			unite(_followOf[1], info.first);
+		}
+		accepting.push_back({ info.last, static_cast<int32_t>(r) });
+	}
+	buildTables();
+
+	_acceptMask.assign(_words, 0);
+	_acceptRule.assign(_words * 64, NO_RULE);
+	for (const auto &[last, rule] : accepting) {
+		for (size_t w = 0; w < _words; ++w) {
+			_acceptMask[w] |= last[w];
+			uint64_t bits = last[w];
+			while (bits != 0) {
+				_acceptRule[w * 64 + __builtin_ctzll(bits)] = rule;
+				bits &= bits - 1;
+			}
+		}
+	}
+	return true;
+}
+
+size_t GlushkovMatcher::getPositionCount() const {
+	return _followOf.size();
+}
+
+size_t GlushkovMatcher::getWordCount() const {
+	return _words;
+}
+
+size_t GlushkovMatcher::bytesUsed() const {
+	return (_follow.size() + _positionsOf.size() + _acceptMask.size()) * sizeof(uint64_t)
+		+ _acceptRule.size() * sizeof(int32_t) + _followOf.size() * sizeof(Bits);
+}
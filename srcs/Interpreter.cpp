@@ -0,0 +1,346 @@
+#include "Interpreter.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+constexpr static char HEX_DIGITS[] = "0123456789abcdef";
+
+Interpreter::Interpreter(const LexFileParser::Content &content, const Nfa &nfa, const GlushkovMatcher *glushkov, size_t cacheBudget, size_t threadCount)
+	: _content(content), _threadCount(std::max<size_t>(threadCount, 1)), _glushkov(glushkov) {
+	size_t automata = _glushkov != nullptr ? 0 : _threadCount > 1 ? _threadCount + 1 : 1;
+	for (size_t i = 0; i < automata; ++i) {
+		_dfas.push_back(std::make_unique<LazyDfa>(nfa, cacheBudget));
+	}
+}
+
+Interpreter::~Interpreter() {}
+
+// Drops the text before the current token and appends more input.
+bool Interpreter::fill() {
+	if (_eof) {
+		return false;
+	}
+	if (_position > 0) {
+		_lineStart = _buffer[_position - 1] == '\n';
+		std::copy(_buffer.begin() + _position, _buffer.begin() + _length, _buffer.begin());
+		_length -= _position;
+		_position = 0;
+	}
+	if (_buffer.size() < _length + READ_SIZE) {
+		_buffer.resize(_length + READ_SIZE);
+	}
+	size_t n = std::fread(_buffer.data() + _length, 1, READ_SIZE, _input);
+	if (n == 0) {
+		_eof = true;
+		return false;
+	}
+	_length += n;
+	return true;
+}
+
+bool Interpreter::atLineStart(const char *data, size_t position) const {
+	return position == 0 ? _lineStart : data[position - 1] == '\n';
+}
+
+bool Interpreter::run(std::FILE *input, std::ostream &out, bool countOnly) {
+	_input = input;
+	_counts.assign(_content.rules.size() + 1, 0);
+	size_t engineCount = _threadCount > 1 ? _threadCount + 1 : 1;
+	bool valid;
+	if (_glushkov == nullptr) {
+		std::vector<LazyDfaEngine> engines;
+		for (const auto &dfa : _dfas) {
+			engines.emplace_back(*dfa);
+		}
+		valid = scan(engines, out, countOnly);
+	} else if (_glushkov->getWordCount() == 1) {
+		std::vector<GlushkovMatcher::Engine<1>> engines(engineCount, GlushkovMatcher::Engine<1>(*_glushkov));
+		valid = scan(engines, out, countOnly);
+	} else {
+		std::vector<GlushkovMatcher::Engine<2>> engines(engineCount, GlushkovMatcher::Engine<2>(*_glushkov));
+		valid = scan(engines, out, countOnly);
+	}
+	if (!valid) {
+		return false;
+	}
+	if (std::ferror(input)) {
+		std::cerr << "Error: Could not read the input" << std::endl;
+		return false;
+	}
+	if (countOnly) {
+		printCounts(out);
+	}
+	out.flush();
+	return static_cast<bool>(out);
+}
+
+template <typename Engine>
+bool Interpreter::scan(std::vector<Engine> &engines, std::ostream &out, bool countOnly) {
+	return _threadCount > 1 ? runParallel(engines, out, countOnly) : runSequential(engines.back(), out, countOnly);
+}
+
+template <typename Engine>
+bool Interpreter::runSequential(Engine &engine, std::ostream &out, bool countOnly) {
+	const size_t defaultRule = _content.rules.size();
+	while (_position < _length || fill()) {
+		typename Engine::State state = engine.start(atLineStart(_buffer.data(), _position));
+		size_t rule = defaultRule;
+		size_t matched = 1;
+		size_t scanned = 0;
+		while (_position + scanned < _length || fill()) {
+			if (!engine.next(state, static_cast<uint8_t>(_buffer[_position + scanned]))) {
+				break;
+			}
+			++scanned;
+			int32_t accept = engine.accept(state);
+			if (accept != Nfa::NO_RULE) {
+				rule = static_cast<size_t>(accept);
+				matched = scanned;
+			}
+		}
+		emit(out, countOnly, rule, _buffer.data() + _position, matched);
+		_position += matched;
+	}
+	return true;
+}
+
+template <typename Engine>
+bool Interpreter::runParallel(std::vector<Engine> &engines, std::ostream &out, bool countOnly) {
+	ThreadPool pool(_threadCount);
+	const size_t windowSize = WINDOW_PER_THREAD * _threadCount;
+	const size_t chunkCount = CHUNKS_PER_THREAD * _threadCount;
+	std::vector<Chunk> chunks;
+	size_t carry = 0;
+	for (;;) {
+		_buffer.resize(carry + windowSize);
+		size_t length = carry;
+		while (length < _buffer.size()) {
+			size_t n = std::fread(_buffer.data() + length, 1, _buffer.size() - length, _input);
+			if (n == 0) {
+				break;
+			}
+			length += n;
+		}
+		bool atEof = length < _buffer.size();
+		if (length == 0) {
+			break;
+		}
+
+		size_t chunkSize = std::max<size_t>((length + chunkCount - 1) / chunkCount, 1);
+		chunks.clear();
+		for (size_t begin = 0; begin < length; begin += chunkSize) {
+			chunks.push_back(Chunk{ begin, std::min(begin + chunkSize, length), {}, begin, false, 0 });
+		}
+		for (size_t i = 0; i < chunks.size(); ++i) {
+			pool.submit([this, &engines, &chunks, i, length, atEof](size_t worker) {
+				scanChunk(engines[worker], _buffer.data(), length, atEof, chunks[i]);
+			});
+		}
+		pool.wait();
+		_chunks += chunks.size();
+
+		size_t consumed = stitch(engines.back(), chunks, length, atEof, out, countOnly);
+		if (atEof) {
+			break;
+		}
+		carry = length - consumed;
+		if (consumed > 0) {
+			_lineStart = _buffer[consumed - 1] == '\n';
+		}
+		std::copy(_buffer.begin() + consumed, _buffer.begin() + length, _buffer.begin());
+	}
+	_steals = pool.getStealCount();
+	return true;
+}
+
+// Scans one token at start. Returns false when the scan was still alive at
+// the end of the window and more input may follow: the token is not known yet.
+template <typename Engine>
+bool Interpreter::scanToken(Engine &engine, const char *data, size_t start, size_t windowEnd, bool atEof, Token &token) const {
+	typename Engine::State state = engine.start(atLineStart(data, start));
+	token = Token{ start, 1, _content.rules.size() };
+	size_t scanned = 0;
+	while (start + scanned < windowEnd) {
+		if (!engine.next(state, static_cast<uint8_t>(data[start + scanned]))) {
+			break;
+		}
+		++scanned;
+		int32_t accept = engine.accept(state);
+		if (accept != Nfa::NO_RULE) {
+			token.rule = static_cast<size_t>(accept);
+			token.length = scanned;
+		}
+	}
+	return start + scanned < windowEnd || atEof;
+}
+
+template <typename Engine>
+void Interpreter::scanChunk(Engine &engine, const char *data, size_t windowEnd, bool atEof, Chunk &chunk) const {
+	auto start = std::chrono::steady_clock::now();
+	size_t position = chunk.begin;
+	Token token;
+	while (position < chunk.limit) {
+		if (!scanToken(engine, data, position, windowEnd, atEof, token)) {
+			chunk.open = true;
+			break;
+		}
+		chunk.tokens.push_back(token);
+		position += token.length;
+	}
+	chunk.end = position;
+	chunk.time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Emits the tokens of the window in input order and returns where the next
+// window has to resume: the end of the window, or the start of a token that
+// could not be finished without more input.
+template <typename Engine>
+size_t Interpreter::stitch(Engine &engine, std::vector<Chunk> &chunks, size_t windowEnd, bool atEof, std::ostream &out, bool countOnly) {
+	const char *data = _buffer.data();
+	size_t position = 0;
+	Token token;
+	for (const Chunk &chunk : chunks) {
+		_scanTime += chunk.time;
+		if (position >= chunk.limit) {
+			// the chunk lies inside a token that is already out
+			continue;
+		}
+		auto next = std::lower_bound(chunk.tokens.begin(), chunk.tokens.end(), position,
+			[](const Token &t, size_t value) { return t.start < value; });
+		while (position < chunk.limit) {
+			if (next != chunk.tokens.end() && next->start == position) {
+				for (; next != chunk.tokens.end(); ++next) {
+					emit(out, countOnly, next->rule, data + next->start, next->length);
+				}
+				position = chunk.end;
+				if (chunk.open) {
+					return position;
+				}
+				break;
+			}
+			if (!scanToken(engine, data, position, windowEnd, atEof, token)) {
+				return position;
+			}
+			emit(out, countOnly, token.rule, data + token.start, token.length);
+			_rescanned += token.length;
+			position += token.length;
+			while (next != chunk.tokens.end() && next->start < position) {
+				++next;
+			}
+		}
+	}
+	return position;
+}
+
+// One token per line: control bytes, backslashes and bytes past ASCII are
+// escaped so that a lexeme never spans lines.
+void Interpreter::emit(std::ostream &out, bool countOnly, size_t rule, const char *text, size_t length) {
+	++_counts[rule];
+	++_tokens;
+	_bytes += length;
+	if (countOnly) {
+		return;
+	}
+	if (rule == _content.rules.size()) {
+		out << "default\t";
+	} else {
+		out << rule << "\t";
+	}
+	for (size_t i = 0; i < length; ++i) {
+		unsigned char c = static_cast<unsigned char>(text[i]);
+		if (c == '\n') {
+			out << "\\n";
+		} else if (c == '\t') {
+			out << "\\t";
+		} else if (c == '\\') {
+			out << "\\\\";
+		} else if (c < 0x20 || c >= 0x7F) {
+			out << "\\x" << HEX_DIGITS[c >> 4] << HEX_DIGITS[c & 15];
+		} else {
+			out << static_cast<char>(c);
+		}
+	}
+	out << "\n";
+}
+
+void Interpreter::printCounts(std::ostream &out) const {
+	for (size_t r = 0; r < _content.rules.size(); ++r) {
+		out << r << "\t" << _counts[r] << "\t" << _content.rules[r].pattern << "\n";
+	}
+	out << "default\t" << _counts[_content.rules.size()] << "\n";
+	out << "total\t" << _tokens << "\n";
+}
+
+size_t Interpreter::getTokenCount() const {
+	return _tokens;
+}
+
+size_t Interpreter::getByteCount() const {
+	return _bytes;
+}
+
+size_t Interpreter::getClassCount() const {
+	return _dfas.empty() ? 0 : _dfas.front()->getClassCount();
+}
+
+size_t Interpreter::getBuiltCount() const {
+	size_t built = 0;
+	for (const auto &dfa : _dfas) {
+		built += dfa->getBuiltCount();
+	}
+	return built;
+}
+
+size_t Interpreter::getCachedCount() const {
+	size_t cached = 0;
+	for (const auto &dfa : _dfas) {
+		cached += dfa->getStateCount();
+	}
+	return cached;
+}
+
+size_t Interpreter::getFlushCount() const {
+	size_t flushes = 0;
+	for (const auto &dfa : _dfas) {
+		flushes += dfa->getFlushCount();
+	}
+	return flushes;
+}
+
+size_t Interpreter::getCacheBytes() const {
+	size_t bytes = 0;
+	for (const auto &dfa : _dfas) {
+		bytes += dfa->bytesUsed();
+	}
+	return bytes;
+}
+
+size_t Interpreter::getCacheBudget() const {
+	return _dfas.empty() ? 0 : _dfas.size() * _dfas.front()->getBudget();
+}
+
+bool Interpreter::isGlushkov() const {
+	return _glushkov != nullptr;
+}
+
+size_t Interpreter::getThreadCount() const {
+	return _threadCount;
+}
+
+size_t Interpreter::getChunkCount() const {
+	return _chunks;
+}
+
+size_t Interpreter::getStealCount() const {
+	return _steals;
+}
+
+size_t Interpreter::getRescannedBytes() const {
+	return _rescanned;
+}
+
+double Interpreter::getScanTime() const {
+	return _scanTime;
+}
@@ -0,0 +1,283 @@
+#include "KeywordTable.hpp"
+#include "RegexArena.hpp"
+
+#include <algorithm>
+#include <unordered_map>
+
+KeywordTable::KeywordTable() {}
+
+KeywordTable::~KeywordTable() {}
+
+// The rule an NFA matching exactly text from the start condition accepts,
+// NO_RULE when there is none.
+int32_t KeywordTable::match(const Nfa &nfa, size_t condition, bool atLineStart, std::string_view text, std::vector<uint32_t> &marks,
+	uint32_t &generation) {
+	auto close = [&](std::vector<Nfa::StateId> &states) {
+		for (size_t i = 0; i < states.size(); ++i) {
+			for (Nfa::StateId t : nfa.getEpsilonEdges(states[i])) {
+				if (marks[t] != generation) {
+					marks[t] = generation;
+					states.push_back(t);
+				}
+			}
+		}
+	};
+
+	std::vector<Nfa::StateId> states = { nfa.getStartState(condition, atLineStart) };
+	std::vector<Nfa::StateId> next;
+	marks[states[0]] = ++generation;
+	close(states);
+	for (char ch : text) {
+		uint8_t byte = static_cast<uint8_t>(ch);
+		++generation;
+		next.clear();
+		for (Nfa::StateId s : states) {
+			for (const auto &edge : nfa.getSetEdges(s)) {
+				if (marks[edge.target] != generation && nfa.getSet(edge.set).contains(byte)) {
+					marks[edge.target] = generation;
+					next.push_back(edge.target);
+				}
+			}
+		}
+		close(next);
+		states.swap(next);
+	}
+
+	int32_t rule = Nfa::NO_RULE;
+	for (Nfa::StateId s : states) {
+		int32_t accept = nfa.getAcceptRule(s);
+		if (accept != Nfa::NO_RULE && (rule == Nfa::NO_RULE || accept < rule)) {
+			rule = accept;
+		}
+	}
+	return rule;
+}
+
+// Every string rule is left out of a probe NFA, which then tells which rule
+// would win each string. Leaving out a rule only changes the winner of its
+// own string, so the strings that fail the test can be put back without
+// affecting the others, except for rules with the same string: a repeated
+// string follows the decision made for its first rule, which is the one
+// that wins it.
+bool KeywordTable::build(const LexFileParser::Content &content, const std::vector<RegexParser::NodeId> &roots, const RegexArena &arena) {
+	_rules.assign(roots.size(), false);
+	_tables.clear();
+	_keywordCount = 0;
+
+	std::vector<std::string_view> texts(roots.size());
+	bool found = false;
+	for (size_t r = 0; r < roots.size(); ++r) {
+		const RegexParser::RegexNode &node = arena.getNode(roots[r]);
+		if (node.type != RegexParser::ATOM) {
+			continue;
+		}
+		const auto &atom = std::get<RegexParser::AtomNode>(node.data);
+		if (atom.type == RegexParser::STRING && atom.valueLength >= 2 && !content.rules[r].lineStart) {
+			texts[r] = arena.getValue(atom);
+			_rules[r] = true;
+			found = true;
+		}
+	}
+	if (!found) {
+		return true;
+	}
+
+	Nfa probe;
+	probe.setLeftOutRules(_rules);
+	if (!probe.build(content, roots, arena)) {
+		return false;
+	}
+
+	std::unordered_map<std::string_view, size_t> firstRule;
+	std::vector<uint32_t> marks(probe.getStateCount(), 0);
+	uint32_t generation = 0;
+	for (size_t r = 0; r < roots.size(); ++r) {
+		if (!_rules[r]) {
+			continue;
+		}
+		auto [first, inserted] = firstRule.try_emplace(texts[r], r);
+		if (!inserted) {
+			_rules[r] = _rules[first->second];
+			continue;
+		}
+
+		int32_t identifier = Nfa::NO_RULE;
+		bool keyword = true;
+		for (size_t c = 0; c < content.startConditions.size() && keyword; ++c) {
+			if (!Nfa::isActive(content, r, c)) {
+				continue;
+			}
+			// at the start of a line too, where an anchored rule may win
+			for (bool atLineStart : { false, true }) {
+				int32_t winner = match(probe, c, atLineStart, texts[r], marks, generation);
+				// a string won by an earlier rule never matches; it stays as is
+				if (winner == Nfa::NO_RULE || static_cast<size_t>(winner) < r || (identifier != Nfa::NO_RULE && winner != identifier)) {
+					keyword = false;
+				}
+				identifier = winner;
+			}
+		}
+		// the lookup runs whenever the identifier rule wins, so both rules
+		// must be active in the same start conditions
+		for (size_t c = 0; c < content.startConditions.size() && keyword; ++c) {
+			keyword = Nfa::isActive(content, r, c) == Nfa::isActive(content, static_cast<size_t>(identifier), c);
+		}
+		if (identifier == Nfa::NO_RULE || !keyword) {
+			_rules[r] = false;
+			continue;
+		}
+		_tables[static_cast<size_t>(identifier)].push_back({ std::string(texts[r]), r });
+		++_keywordCount;
+	}
+
+	for (auto &[identifier, keywords] : _tables) {
+		std::sort(keywords.begin(), keywords.end(), [](const Keyword &a, const Keyword &b) {
+			return a.text.size() != b.text.size() ? a.text.size() < b.text.size() : a.text < b.text;
+		});
+	}
+	return true;
+}
+
+const std::vector<bool> &KeywordTable::getRules() const {
+	return _rules;
+}
+
+const std::map<size_t, std::vector<KeywordTable::Keyword>> &KeywordTable::getTables() const {
+	return _tables;
+}
+
+size_t KeywordTable::getKeywordCount() const {
+	return _keywordCount;
+}
+
+bool KeywordTable::empty() const {
+	return _keywordCount == 0;
+}
+
+void KeywordTable::save(CompileCache::Writer &out) const {
+	out.put(_rules);
+	out.put(static_cast<uint64_t>(_tables.size()));
+	for (const auto &[identifier, keywords] : _tables) {
+		out.put(static_cast<uint64_t>(identifier));
+		out.put(static_cast<uint64_t>(keywords.size()));
+		for (const Keyword &keyword : keywords) {
+			out.put(keyword.text);
+			out.put(static_cast<uint64_t>(keyword.rule));
+		}
+	}
+}
+
+bool KeywordTable::load(CompileCache::Reader &in) {
+	uint64_t tableCount;
+	if (!in.get(_rules) || !in.get(tableCount)) {
+		return false;
+	}
+	_tables.clear();
+	_keywordCount = 0;
+	for (uint64_t t = 0; t < tableCount; ++t) {
+		uint64_t identifier, keywordCount;
+		if (!in.get(identifier) || !in.get(keywordCount) || identifier >= _rules.size()) {
+			return false;
+		}
+		std::vector<Keyword> &keywords = _tables[identifier];
+		for (uint64_t k = 0; k < keywordCount; ++k) {
+			Keyword keyword;
+			uint64_t rule;
+			if (!in.get(keyword.text) || !in.get(rule) || rule >= _rules.size()) {
+				return false;
+			}
+			keyword.rule = rule;
+			keywords.push_back(std::move(keyword));
+			++_keywordCount;
+		}
+	}
+	return true;
+}
+
+uint64_t KeywordTable::hash(std::string_view text, uint64_t seed) {
+	uint64_t h = 14695981039346656037ULL ^ seed;
+	for (char c : text) {
+		h = (h ^ static_cast<uint8_t>(c)) * 1099511628211ULL;
+	}
+	return h;
+}
+
+uint64_t KeywordTable::mix(uint64_t h) {
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return h;
+}
+
+// Buckets of about four keywords are placed largest first, each with the
+// first displacement that puts all of its keywords on free slots, in a
+// table a quarter larger than the keyword count. A seed whose hashes
+// collide, or a bucket that finds no displacement, starts over with the
+// next seed.
+KeywordTable::PerfectHash KeywordTable::buildPerfectHash(const std::vector<Keyword> &keywords) {
+	constexpr uint32_t MAX_DISPLACEMENT = 1 << 16;
+	size_t count = keywords.size();
+	size_t bucketCount = count / 4 + 1;
+	size_t slotCount = count + count / 4 + 1;
+	PerfectHash table;
+	std::vector<uint64_t> hashes(count);
+	for (;; ++table.seed) {
+		for (size_t k = 0; k < count; ++k) {
+			hashes[k] = hash(keywords[k].text, table.seed);
+		}
+		std::vector<uint64_t> sorted = hashes;
+		std::sort(sorted.begin(), sorted.end());
+		if (std::adjacent_find(sorted.begin(), sorted.end()) != sorted.end()) {
+			continue;
+		}
+
+		std::vector<std::vector<uint32_t>> buckets(bucketCount);
+		for (size_t k = 0; k < count; ++k) {
+			buckets[mix(hashes[k]) % bucketCount].push_back(static_cast<uint32_t>(k));
+		}
+		std::vector<uint32_t> order(bucketCount);
+		for (size_t b = 0; b < bucketCount; ++b) {
+			order[b] = static_cast<uint32_t>(b);
+		}
+		std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+			return buckets[a].size() > buckets[b].size();
+		});
+		table.displacements.assign(bucketCount, 0);
+		table.slots.assign(slotCount, -1);
+		std::vector<size_t> placed;
+		bool failed = false;
+		for (uint32_t b : order) {
+			if (buckets[b].empty()) {
+				break;
+			}
+			uint32_t d = 1;
+			for (; d < MAX_DISPLACEMENT; ++d) {
+				placed.clear();
+				for (uint32_t k : buckets[b]) {
+					size_t slot = mix(hashes[k] + d * DISPLACEMENT_STEP) % slotCount;
+					if (table.slots[slot] != -1) {
+						break;
+					}
+					table.slots[slot] = static_cast<int32_t>(k);
+					placed.push_back(slot);
+				}
+				if (placed.size() == buckets[b].size()) {
+					break;
+				}
+				for (size_t slot : placed) {
+					table.slots[slot] = -1;
+				}
+			}
+			if (d == MAX_DISPLACEMENT) {
+				failed = true;
+				break;
+			}
+			table.displacements[b] = d;
+		}
+		if (!failed) {
+			return table;
+		}
+	}
+}
@@ -0,0 +1,142 @@
+#include "LazyDfa.hpp"
+#include "Dfa.hpp"
+
+#include <algorithm>
+
+LazyDfa::LazyDfa(const Nfa &nfa, size_t budget)
+	: _nfa(nfa), _budget(budget), _sets(1024, SetHash{ this }, SetEqual{ this }) {
+	size_t characterSetCount = 0;
+	_classCount = Dfa::computeClasses(nfa, _classMap, characterSetCount);
+	_marks.assign(nfa.getStateCount(), 0);
+	flush();
+	_flushes = 0;
+}
+
+LazyDfa::~LazyDfa() {}
+
+size_t LazyDfa::SetHash::operator()(StateId id) const {
+	uint64_t h = 0xCBF29CE484222325ULL;
+	for (uint32_t i = dfa->_setOffsets[id]; i < dfa->_setOffsets[id + 1]; ++i) {
+		h = (h ^ dfa->_setData[i]) * 0x100000001B3ULL;
+	}
+	return static_cast<size_t>(h ^ (h >> 32));
+}
+
+bool LazyDfa::SetEqual::operator()(StateId a, StateId b) const {
+	uint32_t aBegin = dfa->_setOffsets[a];
+	uint32_t aEnd = dfa->_setOffsets[a + 1];
+	uint32_t bBegin = dfa->_setOffsets[b];
+	uint32_t bEnd = dfa->_setOffsets[b + 1];
+	if (aEnd - aBegin != bEnd - bBegin) {
+		return false;
+	}
+	return std::equal(dfa->_setData.begin() + aBegin, dfa->_setData.begin() + aEnd, dfa->_setData.begin() + bBegin);
+}
+
+// Drops every materialized state but the dead one. Vectors keep their
+// capacity, so refilling the cache does not allocate again.
+void LazyDfa::flush() {
+	_sets.clear();
+	_transitions.clear();
+	_acceptRule.clear();
+	_setData.clear();
+	_setOffsets.assign(1, 0);
+	_startStates.assign(_nfa.getStartStateCount() * 2, UNKNOWN);
+	intern({});
+	++_flushes;
+}
+
+LazyDfa::StateId LazyDfa::intern(const std::vector<Nfa::StateId> &states) {
+	StateId candidate = static_cast<StateId>(_acceptRule.size());
+	_setData.insert(_setData.end(), states.begin(), states.end());
+	_setOffsets.push_back(static_cast<uint32_t>(_setData.size()));
+	auto it = _sets.find(candidate);
+	_setOffsets.pop_back();
+	_setData.resize(_setOffsets.back());
+	if (it != _sets.end()) {
+		return *it;
+	}
+
+	size_t cost = _classCount * sizeof(StateId) + sizeof(int32_t) + states.size() * sizeof(Nfa::StateId)
+		+ sizeof(uint32_t) + SET_ENTRY_BYTES;
+	if (!_acceptRule.empty() && bytesUsed() + cost > _budget) {
+		flush();
+		candidate = static_cast<StateId>(_acceptRule.size());
+	}
+	_setData.insert(_setData.end(), states.begin(), states.end());
+	_setOffsets.push_back(static_cast<uint32_t>(_setData.size()));
+	_sets.insert(candidate);
+
+	int32_t rule = NO_RULE;
+	for (Nfa::StateId s : states) {
+		int32_t accept = _nfa.getAcceptRule(s);
+		if (accept != Nfa::NO_RULE && (rule == NO_RULE || accept < rule)) {
+			rule = accept;
+		}
+	}
+	_acceptRule.push_back(rule);
+	_transitions.resize(_transitions.size() + _classCount, UNKNOWN);
+	if (candidate != DEAD_STATE) {
+		++_built;
+	}
+	return candidate;
+}
+
+LazyDfa::StateId LazyDfa::getStartState(size_t condition, bool atLineStart) {
+	size_t index = condition * 2 + atLineStart;
+	if (_startStates[index] == UNKNOWN) {
+		_work.assign(1, _nfa.getStartState(condition, atLineStart));
+		Dfa::closure(_nfa, _work, _marks, ++_generation);
+		StateId start = intern(_work);
+		_startStates[index] = start;
+	}
+	return _startStates[index];
+}
+
+// Every byte of a class moves the same NFA states, so the byte itself can
+// stand for its class while the target set is computed.
+LazyDfa::StateId LazyDfa::materialize(StateId state, uint8_t byte) {
+	_work.clear();
+	for (uint32_t i = _setOffsets[state]; i < _setOffsets[state + 1]; ++i) {
+		for (const auto &edge : _nfa.getSetEdges(_setData[i])) {
+			if (_nfa.getSet(edge.set).contains(byte)) {
+				_work.push_back(edge.target);
+			}
+		}
+	}
+	Dfa::closure(_nfa, _work, _marks, ++_generation);
+	size_t flushes = _flushes;
+	StateId target = intern(_work);
+	if (_flushes == flushes) {
+		_transitions[state * _classCount + _classMap[byte]] = target;
+	}
+	return target;
+}
+
+size_t LazyDfa::getClassCount() const {
+	return _classCount;
+}
+
+size_t LazyDfa::getStateCount() const {
+	return _acceptRule.size();
+}
+
+size_t LazyDfa::getBuiltCount() const {
+	return _built;
+}
+
+size_t LazyDfa::getFlushCount() const {
+	return _flushes;
+}
+
+size_t LazyDfa::getBudget() const {
+	return _budget;
+}
+
+size_t LazyDfa::bytesUsed() const {
+	return _transitions.size() * sizeof(StateId)
+		+ _acceptRule.size() * sizeof(int32_t)
+		+ _setData.size() * sizeof(Nfa::StateId)
+		+ _setOffsets.size() * sizeof(uint32_t)
+		+ _sets.size() * SET_ENTRY_BYTES;
+}
@@ -1,22 +1,82 @@
 #include "LexFileParser.hpp"
 
-#include <fstream>
 #include <iostream>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 LexFileParser::LexFileParser(const std::string& filename)
-	: _filename(filename), _state(DEFINITIONS), _content(), _isValid(true) {}
+	: _filename(filename), _state(DEFINITIONS), _content(), _isValid(true) {
+	for (size_t i = 0; i < _content.startConditions.size(); ++i) {
+		_startConditionIndex[_content.startConditions[i].name] = i;
+	}
+}
 
-LexFileParser::~LexFileParser() {}
+LexFileParser::~LexFileParser() {
+	if (_mapping) {
+		munmap(const_cast<char *>(_mapping), _mappingSize);
+	}
+}
 
-bool LexFileParser::parse() {
-	std::ifstream file(_filename);
-	if (!file.is_open()) {
+// Maps the file, or reads it whole when it cannot be mapped, as a pipe or
+// an empty file.
+bool LexFileParser::load(std::string_view &text) {
+	int fd = open(_filename.c_str(), O_RDONLY);
+	if (fd < 0) {
 		std::cerr << "Error: Could not open file " << _filename << std::endl;
 		return false;
 	}
+	struct stat st;
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+		void *mapping = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+		if (mapping != MAP_FAILED) {
+			_mapping = static_cast<const char *>(mapping);
+			_mappingSize = static_cast<size_t>(st.st_size);
+			close(fd);
+			text = std::string_view(_mapping, _mappingSize);
+			return true;
+		}
+	}
+	char chunk[65536];
+	ssize_t bytes;
+	while ((bytes = read(fd, chunk, sizeof(chunk))) > 0) {
+		_text.append(chunk, static_cast<size_t>(bytes));
+	}
+	close(fd);
+	if (bytes < 0) {
+		std::cerr << "Error: Could not read file " << _filename << std::endl;
+		return false;
+	}
+	text = _text;
+	return true;
+}
+
+// the next word of text from pos on, empty at the end
+static std::string_view nextWord(std::string_view text, size_t &pos) {
+	size_t start = text.find_first_not_of(" \t", pos);
+	if (start == std::string_view::npos) {
+		pos = text.size();
+		return {};
+	}
+	pos = std::min(text.find_first_of(" \t", start), text.size());
+	return text.substr(start, pos - start);
+}
+
+bool LexFileParser::parse() {
+	std::string_view text;
+	if (!load(text)) {
+		return false;
+	}
 
-	std::string line;
-	while (std::getline(file, line)) {
+	size_t next = 0;
+	while (next < text.size()) {
+		size_t end = std::min(text.find('\n', next), text.size());
+		std::string_view line = text.substr(next, end - next);
+		next = end + 1;
+		++_lineNumber;
 		if (line == "%%") {
 			if (_state == DEFINITIONS) {
 				_state = RULES;
@@ -37,21 +97,24 @@ bool LexFileParser::parse() {
 				break;
 		}
 	}
+	if (_insideAction) {
+		std::cerr << "Unterminated action of the rule at line " << _currentRule.line << std::endl;
+		_isValid = false;
+	}
 
-	return true;
+	return _isValid;
 }
 
-void LexFileParser::handleDefinitionLine(const std::string& line) {
-	static bool insideCodeBlock = false;
-	if (line.find("%{") != std::string::npos) {
-		insideCodeBlock = true;
+void LexFileParser::handleDefinitionLine(std::string_view line) {
+	if (line.find("%{") != std::string_view::npos) {
+		_insideCodeBlock = true;
 		return;
 	}
-	if (line.find("%}") != std::string::npos) {
-		insideCodeBlock = false;
+	if (line.find("%}") != std::string_view::npos) {
+		_insideCodeBlock = false;
 		return;
 	}
-	if (insideCodeBlock) {
+	if (_insideCodeBlock) {
 		_content.definitionCode.push_back(line);
 		return;
 	}
@@ -60,39 +123,41 @@ void LexFileParser::handleDefinitionLine(const std::string& line) {
 		return;
 	}
 	if (!line.empty() && line[0] == '%') {
-		if (line.find("%array") != std::string::npos) {
+		if (line.find("%array") != std::string_view::npos) {
 			_content.yytextType = Content::ARRAY;
-		} else if (line.find("%pointer") != std::string::npos) {
+		} else if (line.find("%pointer") != std::string_view::npos) {
 			_content.yytextType = Content::POINTER;
+		} else if (line.rfind("%option", 0) == 0) {
+			handleOptionLine(line);
 		} else {
 			switch (line[1]) {
 				case 'p': {
-					size_t size = std::stoul(line.substr(2));
+					size_t size = std::stoul(std::string(line.substr(2)));
 					_content.positionsSize = std::max(size, MIN_POSITIONS_SIZE);
 					break;
 				}
 				case 'n': {
-					size_t size = std::stoul(line.substr(2));
+					size_t size = std::stoul(std::string(line.substr(2)));
 					_content.statesSize = std::max(size, MIN_STATES_SIZE);
 					break;
 				}
 				case 'a': {
-					size_t size = std::stoul(line.substr(2));
+					size_t size = std::stoul(std::string(line.substr(2)));
 					_content.transitionsSize = std::max(size, MIN_TRANSITIONS_SIZE);
 					break;
 				}
 				case 'e': {
-					size_t size = std::stoul(line.substr(2));
+					size_t size = std::stoul(std::string(line.substr(2)));
 					_content.parseTreeSize = std::max(size, MIN_PARSE_TREE_SIZE);
 					break;
 				}
 				case 'k': {
-					size_t size = std::stoul(line.substr(2));
+					size_t size = std::stoul(std::string(line.substr(2)));
 					_content.packedCharacterClassesSize = std::max(size, MIN_PACKED_CHARACTER_CLASSES_SIZE);
 					break;
 				}
 				case 'o': {
-					size_t size = std::stoul(line.substr(2));
+					size_t size = std::stoul(std::string(line.substr(2)));
 					_content.outputArraySize = std::max(size, MIN_OUTPUT_ARRAY_SIZE);
 					break;
 				}
@@ -102,21 +167,27 @@ void LexFileParser::handleDefinitionLine(const std::string& line) {
 				case 'X': {
 					bool inclusive = (line[1] == 's' || line[1] == 'S');
 					size_t pos = line.find_first_of(" \t");
-					if (pos == std::string::npos) {
+					if (pos == std::string_view::npos) {
 						std::cerr << "Invalid start condition line: " << line << std::endl;
 						_isValid = false;
 						return;
 					}
-					while (pos < line.size() && (line[pos] == ' ' || line[pos] == '\t')) {
-						++pos;
+					// one line may declare several conditions
+					bool declared = false;
+					for (std::string_view name = nextWord(line, pos); !name.empty(); name = nextWord(line, pos)) {
+						declared = true;
+						// lex only warns, and keeps the first declaration
+						if (!_startConditionIndex.emplace(name, _content.startConditions.size()).second) {
+							std::cerr << "Warning: Start condition declared twice: " << name << std::endl;
+							continue;
+						}
+						_content.startConditions.push_back({ name, inclusive });
 					}
-					std::string name = line.substr(pos);
-					if (name.empty()) {
+					if (!declared) {
 						std::cerr << "Invalid start condition name in line: " << line << std::endl;
 						_isValid = false;
 						return;
 					}
-					_content.startConditions.push_back({ name, inclusive });
 					break;
 				}
 				default:
@@ -128,12 +199,12 @@ void LexFileParser::handleDefinitionLine(const std::string& line) {
 	}
 	if (!line.empty()) {
 		size_t pos = line.find_first_of(" \t");
-		if (pos != std::string::npos) {
-			std::string key = line.substr(0, pos);
+		if (pos != std::string_view::npos) {
+			std::string_view key = line.substr(0, pos);
 			while (pos < line.size() && (line[pos] == ' ' || line[pos] == '\t')) {
 				++pos;
 			}
-			std::string value = line.substr(pos);
+			std::string_view value = line.substr(pos);
 			if (key.empty() || value.empty()) {
 				std::cerr << "Invalid substitution line: " << line << std::endl;
 				_isValid = false;
@@ -144,107 +215,158 @@ void LexFileParser::handleDefinitionLine(const std::string& line) {
 	}
 }
 
-static bool isActionFinished(const std::string& action) {
-	bool inSimpleQuote = false;
-	bool inDoubleQuote = false;
-	bool inComment = false;
-	int depth = 0;
-	size_t pos = 0;
-	while (pos < action.size()) {
-		if (action[pos] == '\'' && !inDoubleQuote && !inComment) {
-			inSimpleQuote = !inSimpleQuote;
-		} else if (action[pos] == '\"' && !inSimpleQuote && !inComment) {
-			inDoubleQuote = !inDoubleQuote;
-		} else if (!inSimpleQuote && !inDoubleQuote) {
-			if (!inComment && action.substr(pos, 2) == "/*") {
-				inComment = true;
-			} else if (inComment && action.substr(pos, 2) == "*/") {
-				inComment = false;
+void LexFileParser::handleOptionLine(std::string_view line) {
+	size_t pos = 7;
+	for (std::string_view option = nextWord(line, pos); !option.empty(); option = nextWord(line, pos)) {
+		if (option == "direct") {
+			_content.scannerStyle = Content::DIRECT_CODED;
+		} else if (option == "tables") {
+			_content.scannerStyle = Content::TABLE_DRIVEN;
+		} else if (option == "reentrant") {
+			_content.reentrant = true;
+		} else if (option.starts_with("bufsize=")) {
+			std::string value(option.substr(8));
+			if (value.empty() || value.size() > 12 || value.find_first_not_of("0123456789") != std::string::npos || std::stoul(value) == 0) {
+				std::cerr << "Invalid buffer size: " << value << std::endl;
+				_isValid = false;
+				continue;
 			}
+			_content.bufferSize = std::stoul(value);
+		} else {
+			std::cerr << "Unknown option: " << option << std::endl;
+			_isValid = false;
 		}
-		if (!inSimpleQuote && !inDoubleQuote && !inComment) {
-			if (action[pos] == '{') {
-				++depth;
-			} else if (action[pos] == '}') {
-				--depth;
+	}
+}
+
+void LexFileParser::ActionScanner::feed(std::string_view text) {
+	for (size_t pos = 0; pos < text.size(); ++pos) {
+		char c = text[pos];
+		if (inComment) {
+			if (c == '*' && pos + 1 < text.size() && text[pos + 1] == '/') {
+				inComment = false;
+				++pos;
+			}
+		} else if (inSimpleQuote || inDoubleQuote) {
+			if (c == '\\') {
+				++pos;
+			} else if (c == (inSimpleQuote ? '\'' : '\"')) {
+				inSimpleQuote = inDoubleQuote = false;
 			}
+		} else if (c == '\'') {
+			inSimpleQuote = true;
+		} else if (c == '\"') {
+			inDoubleQuote = true;
+		} else if (c == '/' && pos + 1 < text.size() && text[pos + 1] == '*') {
+			inComment = true;
+			++pos;
+		} else if (c == '/' && pos + 1 < text.size() && text[pos + 1] == '/') {
+			// a line comment
+			return;
+		} else if (c == '{') {
+			++depth;
+		} else if (c == '}') {
+			--depth;
 		}
-		++pos;
-	}
-	if (!inSimpleQuote && !inDoubleQuote && !inComment && depth == 0) {
-		return true;
 	}
-	return false;
 }
 
-void LexFileParser::handleRuleLine(const std::string& line) {
-	static Content::Rule currentRule = { "", "", {} };
-	if (line.empty()) {
-		return;
+bool LexFileParser::ActionScanner::isFinished() const {
+	return !inSimpleQuote && !inDoubleQuote && !inComment && depth == 0;
+}
+
+// the end of the pattern that starts a rule line at pos: the first blank
+// outside of a string or a character class
+static size_t findPatternEnd(std::string_view line, size_t pos) {
+	bool inString = false;
+	size_t classStart = std::string_view::npos;
+	for (; pos < line.size(); ++pos) {
+		char c = line[pos];
+		if (c == '\\') {
+			++pos;
+		} else if (classStart != std::string_view::npos) {
+			// a ] first in the class, or first after ^, is a member
+			if (c == ']' && pos > classStart && !(pos == classStart + 1 && line[classStart] == '^')) {
+				classStart = std::string_view::npos;
+			}
+		} else if (c == '\"') {
+			inString = !inString;
+		} else if (inString) {
+			continue;
+		} else if (c == '[') {
+			classStart = pos + 1;
+		} else if (c == ' ' || c == '\t') {
+			break;
+		}
 	}
-	if (currentRule.pattern.empty()) {
+	return std::min(pos, line.size());
+}
+
+void LexFileParser::handleRuleLine(std::string_view line) {
+	if (_insideAction) {
+		// the action grows over the next line, the newline included
+		_currentRule.action = std::string_view(_currentRule.action.data(), line.data() + line.size() - _currentRule.action.data());
+		_action.feed(line);
+	} else {
+		if (line.empty()) {
+			return;
+		}
 		size_t pos = 0;
-		std::vector<std::string> conditions;
+		std::vector<std::string_view> conditions;
 		if (line[pos] == '<') {
 			pos = line.find('>');
-			if (pos == std::string::npos) {
+			if (pos == std::string_view::npos) {
 				std::cerr << "Invalid rule line (missing '>'): " << line << std::endl;
 				_isValid = false;
 				return;
 			}
-			std::string conditionsStr = line.substr(1, pos - 1);
+			std::string_view conditionsStr = line.substr(1, pos - 1);
 			size_t start = 0;
 			while (start < conditionsStr.size()) {
 				size_t commaPos = conditionsStr.find(',', start);
-				if (commaPos == std::string::npos) {
+				if (commaPos == std::string_view::npos) {
 					commaPos = conditionsStr.size();
 				}
-				std::string condition = conditionsStr.substr(start, commaPos - start);
-				bool found = false;
-				for (auto& sc : _content.startConditions) {
-					if (sc.name == condition) {
-						if (std::find(conditions.begin(), conditions.end(), condition) == conditions.end()) {
-							conditions.push_back(condition);
-						} else {
-							std::cerr << "Duplicate start condition in rule: " << condition << std::endl;
-							_isValid = false;
-						}
-						found = true;
-						break;
-					}
-				}
-				if (!found) {
+				std::string_view condition = conditionsStr.substr(start, commaPos - start);
+				if (!_startConditionIndex.contains(condition)) {
 					std::cerr << "Unknown start condition: " << condition << std::endl;
 					_isValid = false;
+				} else if (std::find(conditions.begin(), conditions.end(), condition) == conditions.end()) {
+					conditions.push_back(condition);
+				} else {
+					std::cerr << "Duplicate start condition in rule: " << condition << std::endl;
+					_isValid = false;
 				}
 				start = commaPos + 1;
 			}
 			++pos;
 		}
-		size_t patternStart = pos;;
-		while (pos < line.size() && line[pos] != ' ' && line[pos] != '\t') {
-			++pos;
+		size_t patternStart = pos;
+		pos = findPatternEnd(line, pos);
+		std::string_view pattern = line.substr(patternStart, pos - patternStart);
+		bool lineStart = pattern.size() > 1 && pattern[0] == '^';
+		if (lineStart) {
+			pattern.remove_prefix(1);
 		}
-		std::string pattern = line.substr(patternStart, pos - patternStart);
 		while (pos < line.size() && (line[pos] == ' ' || line[pos] == '\t')) {
 			++pos;
 		}
-		std::string action = line.substr(pos);
-		currentRule = { pattern, action, conditions };
-	} else {
-		currentRule.action += "\n" + line;
+		std::string_view action = line.substr(pos);
+		_currentRule = { pattern, action, std::move(conditions), _lineNumber, lineStart };
+		_action = ActionScanner();
+		_action.feed(action);
 	}
-	if (isActionFinished(currentRule.action)) {
-		_content.rules.push_back(currentRule);
-		currentRule = { "", "", {} };
+	_insideAction = !_action.isFinished();
+	if (!_insideAction) {
+		_content.rules.push_back(std::move(_currentRule));
 	}
 }
 
-void LexFileParser::handleUserSubroutineLine(const std::string& line) {
+void LexFileParser::handleUserSubroutineLine(std::string_view line) {
 	_content.userSubroutinesCode.push_back(line);
 }
 
-LexFileParser::Content LexFileParser::getContent() const {
+const LexFileParser::Content &LexFileParser::getContent() const {
 	return _content;
 }
 
@@ -0,0 +1,511 @@
+#include "Nfa.hpp"
+#include "RegexArena.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <tuple>
+#include <unordered_map>
+
+Nfa::Nfa() {}
+
+Nfa::~Nfa() {}
+
+Nfa::StateId Nfa::newState() {
+	if (_acceptRule.size() >= UINT32_MAX || _acceptRule.size() >= _stateLimit) {
+		throw std::runtime_error("Too many NFA states");
+	}
+	_acceptRule.push_back(NO_RULE);
+	return static_cast<StateId>(_acceptRule.size() - 1);
+}
+
+void Nfa::addEpsilon(StateId from, StateId to) {
+	_pendingEpsilon.push_back({ from, to });
+}
+
+void Nfa::addSet(StateId from, StateId to, CharSetTable::SetId set) {
+	_pendingSets.push_back({ from, SetEdge{ to, set } });
+}
+
+CharSetTable::SetId Nfa::singleton(uint8_t byte) {
+	if (_singletons[byte] == CharSetTable::NO_SET) {
+		_singletons[byte] = _sets.intern(CharSet::single(byte));
+	}
+	return _singletons[byte];
+}
+
+Nfa::Fragment Nfa::lowerAtom(const RegexParser::AtomNode &atom) {
+	Fragment fragment{ newState(), 0 };
+	if (atom.type == RegexParser::STRING) {
+		StateId current = fragment.start;
+		for (char ch : _arena->getValue(atom)) {
+			StateId next = newState();
+			addSet(current, next, singleton(static_cast<uint8_t>(ch)));
+			current = next;
+		}
+		fragment.end = current;
+		return fragment;
+	}
+	// the NFA's table starts as a copy of the arena's, so the ids agree
+	fragment.end = newState();
+	addSet(fragment.start, fragment.end, atom.set);
+	return fragment;
+}
+
+Nfa::Fragment Nfa::lowerQuantifier(const RegexParser::QuantifierNode &quantifier) {
+	if (quantifier.quantifierType == RegexParser::NONE) {
+		return lower(quantifier.node);
+	}
+	if (quantifier.quantifierType == RegexParser::RANGE) {
+		return lowerRange(quantifier);
+	}
+	Fragment fragment{ newState(), newState() };
+	switch (quantifier.quantifierType) {
+		case RegexParser::NONE:
+			break;
+		case RegexParser::STAR: {
+			Fragment inner = lower(quantifier.node);
+			addEpsilon(fragment.start, inner.start);
+			addEpsilon(fragment.start, fragment.end);
+			addEpsilon(inner.end, inner.start);
+			addEpsilon(inner.end, fragment.end);
+			break;
+		}
+		case RegexParser::PLUS: {
+			Fragment inner = lower(quantifier.node);
+			addEpsilon(fragment.start, inner.start);
+			addEpsilon(inner.end, inner.start);
+			addEpsilon(inner.end, fragment.end);
+			break;
+		}
+		case RegexParser::OPTIONAL: {
+			Fragment inner = lower(quantifier.node);
+			addEpsilon(fragment.start, inner.start);
+			addEpsilon(fragment.start, fragment.end);
+			addEpsilon(inner.end, fragment.end);
+			break;
+		}
+		case RegexParser::RANGE:
+			break;
+	}
+	return fragment;
+}
+
+// x{m,n} is m copies of x followed by n - m optional ones, where each
+// optional copy may skip to the end: (x(x(x)?)?)? rather than x?x?x?, so the
+// subsets of the DFA stay small. x{m,} loops on its last copy. The body is
+// lowered once and the other copies are cloned from its states and edges,
+// which keeps nested repetitions linear in the size of the result.
+Nfa::Fragment Nfa::lowerRange(const RegexParser::QuantifierNode &quantifier) {
+	bool unbounded = quantifier.max == RegexParser::UNBOUNDED;
+	int copies = unbounded ? std::max(quantifier.min, 1) : quantifier.max;
+	Fragment fragment{ newState(), newState() };
+	if (copies == 0) {
+		addEpsilon(fragment.start, fragment.end);
+		return fragment;
+	}
+
+	Template body{ {}, static_cast<StateId>(_acceptRule.size()), 0, _pendingEpsilon.size(), 0, _pendingSets.size(), 0 };
+	body.fragment = lower(quantifier.node);
+	body.endState = static_cast<StateId>(_acceptRule.size());
+	body.endEpsilon = _pendingEpsilon.size();
+	body.endSetEdge = _pendingSets.size();
+
+	StateId current = fragment.start;
+	Fragment copy = body.fragment;
+	for (int i = 0; i < copies; ++i) {
+		if (i > 0) {
+			copy = clone(body);
+		}
+		if (i >= quantifier.min) {
+			addEpsilon(current, fragment.end);
+		}
+		addEpsilon(current, copy.start);
+		current = copy.end;
+	}
+	if (unbounded) {
+		addEpsilon(copy.end, copy.start);
+	}
+	addEpsilon(current, fragment.end);
+	return fragment;
+}
+
+Nfa::Fragment Nfa::clone(const Template &body) {
+	StateId offset = static_cast<StateId>(_acceptRule.size()) - body.firstState;
+	for (StateId s = body.firstState; s < body.endState; ++s) {
+		newState();
+	}
+	for (size_t e = body.firstEpsilon; e < body.endEpsilon; ++e) {
+		auto [from, to] = _pendingEpsilon[e];
+		addEpsilon(from + offset, to + offset);
+	}
+	for (size_t e = body.firstSetEdge; e < body.endSetEdge; ++e) {
+		auto [from, edge] = _pendingSets[e];
+		addSet(from + offset, edge.target + offset, edge.set);
+	}
+	return { body.fragment.start + offset, body.fragment.end + offset };
+}
+
+Nfa::Fragment Nfa::lower(RegexParser::NodeId id) {
+	const RegexParser::RegexNode &node = _arena->getNode(id);
+	switch (node.type) {
+		case RegexParser::ATOM:
+			return lowerAtom(std::get<RegexParser::AtomNode>(node.data));
+		case RegexParser::CONCATENATION: {
+			const auto &concat = std::get<RegexParser::ConcatenationNode>(node.data);
+			Fragment left = lower(concat.left);
+			Fragment right = lower(concat.right);
+			addEpsilon(left.end, right.start);
+			return { left.start, right.end };
+		}
+		case RegexParser::ALTERNATION: {
+			const auto &alt = std::get<RegexParser::AlternationNode>(node.data);
+			Fragment fragment{ newState(), newState() };
+			Fragment left = lower(alt.left);
+			Fragment right = lower(alt.right);
+			addEpsilon(fragment.start, left.start);
+			addEpsilon(fragment.start, right.start);
+			addEpsilon(left.end, fragment.end);
+			addEpsilon(right.end, fragment.end);
+			return fragment;
+		}
+		case RegexParser::QUANTIFIER:
+			return lowerQuantifier(std::get<RegexParser::QuantifierNode>(node.data));
+	}
+	throw std::runtime_error("Unknown regex node type");
+}
+
+// Counting sort of the pending edge lists by source state into CSR arrays.
+void Nfa::finalize() {
+	size_t stateCount = _acceptRule.size();
+
+	_epsilonOffsets.assign(stateCount + 1, 0);
+	for (const auto &edge : _pendingEpsilon) {
+		++_epsilonOffsets[edge.first + 1];
+	}
+	for (size_t s = 0; s < stateCount; ++s) {
+		_epsilonOffsets[s + 1] += _epsilonOffsets[s];
+	}
+	_epsilonTargets.resize(_pendingEpsilon.size());
+	std::vector<uint32_t> cursor(_epsilonOffsets.begin(), _epsilonOffsets.end() - 1);
+	for (const auto &edge : _pendingEpsilon) {
+		_epsilonTargets[cursor[edge.first]++] = edge.second;
+	}
+
+	_setOffsets.assign(stateCount + 1, 0);
+	for (const auto &edge : _pendingSets) {
+		++_setOffsets[edge.first + 1];
+	}
+	for (size_t s = 0; s < stateCount; ++s) {
+		_setOffsets[s + 1] += _setOffsets[s];
+	}
+	_setEdges.resize(_pendingSets.size());
+	cursor.assign(_setOffsets.begin(), _setOffsets.end() - 1);
+	for (const auto &edge : _pendingSets) {
+		_setEdges[cursor[edge.first]++] = edge.second;
+	}
+
+	std::vector<std::pair<StateId, StateId>>().swap(_pendingEpsilon);
+	std::vector<std::pair<StateId, SetEdge>>().swap(_pendingSets);
+}
+
+bool Nfa::checkLimits(const LexFileParser::Content &content) const {
+	bool valid = true;
+	if (getPositionCount() > content.positionsSize) {
+		std::cerr << "Error: " << getPositionCount() << " positions exceed the %p limit of " << content.positionsSize << std::endl;
+		valid = false;
+	}
+	if (getStateCount() > content.statesSize) {
+		std::cerr << "Error: " << getStateCount() << " NFA states exceed the %n limit of " << content.statesSize << std::endl;
+		valid = false;
+	}
+	if (getEpsilonCount() + getSetEdgeCount() > content.transitionsSize) {
+		std::cerr << "Error: " << getEpsilonCount() + getSetEdgeCount() << " NFA transitions exceed the %a limit of " << content.transitionsSize << std::endl;
+		valid = false;
+	}
+	return valid;
+}
+
+bool Nfa::isActive(const LexFileParser::Content &content, size_t rule, size_t condition) {
+	const auto &ruleConditions = content.rules[rule].startConditions;
+	if (ruleConditions.empty()) {
+		return content.startConditions[condition].inclusive;
+	}
+	return std::find(ruleConditions.begin(), ruleConditions.end(), content.startConditions[condition].name) != ruleConditions.end();
+}
+
+// Groups the rules by the start conditions they are active in, whether they
+// are anchored, and the first byte of their leading literal; the literals of
+// groups of two or more rules go into a trie with one root per set of start
+// conditions and anchoring. prefixEnd[r] is the trie node where the literal
+// of rule r ends, NO_STATE when r is lowered on its own.
+void Nfa::buildPrefixTrie(const LexFileParser::Content &content, const std::vector<std::vector<RegexParser::NodeId>> &factors,
+	std::vector<StateId> &prefixEnd) {
+	std::map<std::tuple<std::vector<bool>, bool, uint8_t>, std::vector<size_t>> groups;
+	for (size_t r = 0; r < factors.size(); ++r) {
+		if (isLeftOut(r)) {
+			continue;
+		}
+		const RegexParser::RegexNode &head = _arena->getNode(factors[r][0]);
+		if (head.type != RegexParser::ATOM) {
+			continue;
+		}
+		const auto &atom = std::get<RegexParser::AtomNode>(head.data);
+		if ((atom.type != RegexParser::STRING && atom.type != RegexParser::CHARACTER) || atom.valueLength == 0) {
+			continue;
+		}
+		std::vector<bool> conditions(content.startConditions.size());
+		for (size_t c = 0; c < conditions.size(); ++c) {
+			conditions[c] = isActive(content, r, c);
+		}
+		groups[{ conditions, content.rules[r].lineStart, static_cast<uint8_t>(_arena->getValue(atom)[0]) }].push_back(r);
+	}
+
+	_sharedBegin = static_cast<StateId>(_acceptRule.size());
+	std::map<std::pair<std::vector<bool>, bool>, StateId> trieRoots;
+	std::unordered_map<uint64_t, StateId> children;
+	for (const auto &[key, rules] : groups) {
+		if (rules.size() < 2) {
+			continue;
+		}
+		const auto &[conditions, lineStart, byte] = key;
+		auto [root, inserted] = trieRoots.try_emplace({ conditions, lineStart }, 0);
+		if (inserted) {
+			root->second = newState();
+			for (size_t c = 0; c < conditions.size(); ++c) {
+				if (conditions[c]) {
+					addEpsilon(getStartState(c, lineStart), root->second);
+				}
+			}
+		}
+		for (size_t r : rules) {
+			StateId state = root->second;
+			for (char ch : _arena->getValue(std::get<RegexParser::AtomNode>(_arena->getNode(factors[r][0]).data))) {
+				uint8_t byte = static_cast<uint8_t>(ch);
+				auto [child, created] = children.try_emplace((static_cast<uint64_t>(state) << 8) | byte, 0);
+				if (created) {
+					child->second = newState();
+					addSet(state, child->second, singleton(byte));
+				}
+				state = child->second;
+			}
+			prefixEnd[r] = state;
+		}
+	}
+	_sharedEnd = static_cast<StateId>(_acceptRule.size());
+}
+
+bool Nfa::build(const LexFileParser::Content &content, const std::vector<RegexParser::NodeId> &roots, const RegexArena &arena) {
+	_arena = &arena;
+	_ruleCount = roots.size();
+	_sets = arena.getSets();
+	_singletons.fill(CharSetTable::NO_SET);
+	// the %n check below reports the real count when it is close; this
+	// only bounds patterns that would lower to far more states
+	_stateLimit = std::max<size_t>(content.statesSize * 4, 65536);
+
+	_lineStart = false;
+	for (size_t r = 0; r < roots.size(); ++r) {
+		_lineStart = _lineStart || (content.rules[r].lineStart && !isLeftOut(r));
+	}
+	size_t conditionCount = content.startConditions.size();
+	_startStates.clear();
+	for (size_t c = 0; c < conditionCount; ++c) {
+		StateId start = newState();
+		_startStates.push_back(start);
+		_startStates.push_back(_lineStart ? newState() : start);
+		if (_lineStart) {
+			addEpsilon(_startStates.back(), start);
+		}
+	}
+
+	std::vector<std::vector<RegexParser::NodeId>> factors(roots.size());
+	for (size_t r = 0; r < roots.size(); ++r) {
+		arena.appendFactors(roots[r], factors[r]);
+	}
+	std::vector<StateId> prefixEnd(roots.size(), NO_STATE);
+	buildPrefixTrie(content, factors, prefixEnd);
+
+	_ruleBegin.clear();
+	for (size_t r = 0; r < roots.size(); ++r) {
+		_ruleBegin.push_back(static_cast<StateId>(_acceptRule.size()));
+		if (isLeftOut(r)) {
+			continue;
+		}
+		Fragment fragment;
+		try {
+			if (prefixEnd[r] == NO_STATE) {
+				fragment = lower(roots[r]);
+			} else {
+				fragment = { prefixEnd[r], prefixEnd[r] };
+				for (size_t i = 1; i < factors[r].size(); ++i) {
+					Fragment next = lower(factors[r][i]);
+					addEpsilon(fragment.end, next.start);
+					fragment.end = next.end;
+				}
+			}
+		} catch (const std::runtime_error &e) {
+			std::cerr << "Error: Rule at line " << content.rules[r].line << " (" << content.rules[r].pattern
+				<< ") needs more NFA states than the %n limit of " << content.statesSize << " allows" << std::endl;
+			return false;
+		}
+		// two rules with the same literal end on the same trie node
+		if (_acceptRule[fragment.end] == NO_RULE) {
+			_acceptRule[fragment.end] = static_cast<int32_t>(r);
+		}
+		if (prefixEnd[r] != NO_STATE) {
+			continue;
+		}
+		for (size_t c = 0; c < conditionCount; ++c) {
+			if (isActive(content, r, c)) {
+				addEpsilon(getStartState(c, content.rules[r].lineStart), fragment.start);
+			}
+		}
+	}
+
+	_ruleBegin.push_back(static_cast<StateId>(_acceptRule.size()));
+
+	finalize();
+	return checkLimits(content);
+}
+
+size_t Nfa::getStateCount() const {
+	return _acceptRule.size();
+}
+
+size_t Nfa::getEpsilonCount() const {
+	return _epsilonTargets.size();
+}
+
+size_t Nfa::getSetEdgeCount() const {
+	return _setEdges.size();
+}
+
+size_t Nfa::getPositionCount() const {
+	size_t positions = 0;
+	for (size_t s = 0; s + 1 < _setOffsets.size(); ++s) {
+		if (_setOffsets[s] != _setOffsets[s + 1]) {
+			++positions;
+		}
+	}
+	return positions;
+}
+
+size_t Nfa::getRuleCount() const {
+	return _ruleCount;
+}
+
+size_t Nfa::bytesUsed() const {
+	return _acceptRule.capacity() * sizeof(int32_t)
+		+ _startStates.capacity() * sizeof(StateId)
+		+ _epsilonOffsets.capacity() * sizeof(uint32_t)
+		+ _epsilonTargets.capacity() * sizeof(StateId)
+		+ _setOffsets.capacity() * sizeof(uint32_t)
+		+ _setEdges.capacity() * sizeof(SetEdge)
+		+ _sets.bytesUsed();
+}
+
+std::span<const Nfa::StateId> Nfa::getEpsilonEdges(StateId state) const {
+	return std::span<const StateId>(_epsilonTargets.data() + _epsilonOffsets[state], _epsilonOffsets[state + 1] - _epsilonOffsets[state]);
+}
+
+std::span<const Nfa::SetEdge> Nfa::getSetEdges(StateId state) const {
+	return std::span<const SetEdge>(_setEdges.data() + _setOffsets[state], _setOffsets[state + 1] - _setOffsets[state]);
+}
+
+const CharSet &Nfa::getSet(CharSetTable::SetId id) const {
+	return _sets.get(id);
+}
+
+size_t Nfa::getSetCount() const {
+	return _sets.size();
+}
+
+int32_t Nfa::getAcceptRule(StateId state) const {
+	return _acceptRule[state];
+}
+
+Nfa::StateId Nfa::getStartState(size_t condition, bool atLineStart) const {
+	return _startStates[condition * 2 + atLineStart];
+}
+
+size_t Nfa::getStartStateCount() const {
+	return _startStates.size() / 2;
+}
+
+bool Nfa::hasLineStartRules() const {
+	return _lineStart;
+}
+
+std::pair<Nfa::StateId, Nfa::StateId> Nfa::getRuleStates(size_t rule) const {
+	return { _ruleBegin[rule], _ruleBegin[rule + 1] };
+}
+
+void Nfa::setLeftOutRules(const std::vector<bool> &rules) {
+	_leftOut = rules;
+}
+
+bool Nfa::isLeftOut(size_t rule) const {
+	return rule < _leftOut.size() && _leftOut[rule];
+}
+
+std::pair<Nfa::StateId, Nfa::StateId> Nfa::getSharedStates() const {
+	return { _sharedBegin, _sharedEnd };
+}
+
+void Nfa::save(CompileCache::Writer &out) const {
+	out.put(static_cast<uint64_t>(_ruleCount));
+	out.put(_ruleBegin);
+	out.put(_leftOut);
+	out.put(static_cast<uint64_t>(_sharedBegin));
+	out.put(static_cast<uint64_t>(_sharedEnd));
+	out.put(_acceptRule);
+	out.put(_startStates);
+	out.put(static_cast<uint64_t>(_lineStart));
+	out.put(static_cast<uint64_t>(_sets.size()));
+	for (CharSetTable::SetId id = 0; id < _sets.size(); ++id) {
+		std::vector<uint8_t> ranges;
+		_sets.get(id).forEachRange([&](uint8_t first, uint8_t last) {
+			ranges.push_back(first);
+			ranges.push_back(last);
+		});
+		out.put(ranges);
+	}
+	out.put(_epsilonOffsets);
+	out.put(_epsilonTargets);
+	out.put(_setOffsets);
+	out.put(_setEdges);
+}
+
+bool Nfa::load(CompileCache::Reader &in) {
+	uint64_t ruleCount, sharedBegin, sharedEnd, lineStart, setCount;
+	if (!in.get(ruleCount) || !in.get(_ruleBegin) || !in.get(_leftOut) || !in.get(sharedBegin) || !in.get(sharedEnd)
+		|| !in.get(_acceptRule) || !in.get(_startStates) || !in.get(lineStart) || !in.get(setCount)) {
+		return false;
+	}
+	_ruleCount = ruleCount;
+	_sharedBegin = static_cast<StateId>(sharedBegin);
+	_sharedEnd = static_cast<StateId>(sharedEnd);
+	_lineStart = lineStart != 0;
+	_sets.clear();
+	for (uint64_t s = 0; s < setCount; ++s) {
+		std::vector<uint8_t> ranges;
+		if (!in.get(ranges) || ranges.size() % 2 != 0) {
+			return false;
+		}
+		CharSet set;
+		for (size_t i = 0; i < ranges.size(); i += 2) {
+			set.addRange(ranges[i], ranges[i + 1]);
+		}
+		_sets.intern(set);
+	}
+	if (!in.get(_epsilonOffsets) || !in.get(_epsilonTargets) || !in.get(_setOffsets) || !in.get(_setEdges)) {
+		return false;
+	}
+	// the sizes code generation indexes by
+	size_t states = _acceptRule.size();
+	return _sets.size() == setCount && _ruleBegin.size() == _ruleCount + 1 && _startStates.size() % 2 == 0
+		&& _epsilonOffsets.size() == states + 1 && _epsilonOffsets.back() == _epsilonTargets.size()
+		&& _setOffsets.size() == states + 1 && _setOffsets.back() == _setEdges.size();
+}
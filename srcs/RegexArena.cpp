@@ -0,0 +1,144 @@
+#include "RegexArena.hpp"
+
+#include <stdexcept>
+
+RegexArena::RegexArena() {}
+
+RegexArena::~RegexArena() {}
+
+size_t RegexArena::NodeKeyHash::operator()(const NodeKey &key) const {
+	uint64_t h = key.type;
+	h = h * 0x9E3779B97F4A7C15ULL + key.a;
+	h = h * 0x9E3779B97F4A7C15ULL + key.b;
+	h = h * 0x9E3779B97F4A7C15ULL + static_cast<uint32_t>(key.min);
+	h = h * 0x9E3779B97F4A7C15ULL + static_cast<uint32_t>(key.max);
+	return static_cast<size_t>(h ^ (h >> 32));
+}
+
+RegexArena::NodeKey RegexArena::makeKey(const RegexParser::RegexNode &node) {
+	switch (node.type) {
+		case RegexParser::CONCATENATION: {
+			const auto &c = std::get<RegexParser::ConcatenationNode>(node.data);
+			return { RegexParser::CONCATENATION, c.left, c.right, 0, 0 };
+		}
+		case RegexParser::ALTERNATION: {
+			const auto &a = std::get<RegexParser::AlternationNode>(node.data);
+			return { RegexParser::ALTERNATION, a.left, a.right, 0, 0 };
+		}
+		case RegexParser::QUANTIFIER: {
+			const auto &q = std::get<RegexParser::QuantifierNode>(node.data);
+			return { RegexParser::QUANTIFIER, q.node, static_cast<uint32_t>(q.quantifierType), q.min, q.max };
+		}
+		case RegexParser::ATOM:
+			break;
+	}
+	throw std::runtime_error("Atoms must be interned through addAtom");
+}
+
+RegexArena::NodeId RegexArena::push(const RegexParser::RegexNode &node) {
+	if (_nodes.size() >= RegexParser::NO_NODE) {
+		throw std::runtime_error("Regex arena is full");
+	}
+	_nodes.push_back(node);
+	return static_cast<NodeId>(_nodes.size() - 1);
+}
+
+RegexArena::NodeId RegexArena::addNode(const RegexParser::RegexNode &node) {
+	NodeKey key = makeKey(node);
+	auto it = _internedNodes.find(key);
+	if (it != _internedNodes.end()) {
+		++_sharedHits;
+		return it->second;
+	}
+	NodeId id = push(node);
+	_internedNodes.emplace(key, id);
+	return id;
+}
+
+RegexArena::NodeId RegexArena::addAtom(RegexParser::AtomType type, std::string_view value) {
+	if (type == RegexParser::CHARACTER_CLASS) {
+		return addClass(value, RegexParser::decodeClass(value));
+	}
+	std::string key(1, static_cast<char>(type));
+	key.append(value);
+	auto it = _internedAtoms.find(key);
+	if (it != _internedAtoms.end()) {
+		++_sharedHits;
+		return it->second;
+	}
+	CharSetTable::SetId set = CharSetTable::NO_SET;
+	if (type == RegexParser::CHARACTER) {
+		set = _sets.intern(CharSet::single(static_cast<uint8_t>(value[0])));
+	} else if (type == RegexParser::WILDCARD) {
+		set = _sets.intern(CharSet::all() - CharSet::single('\n'));
+	}
+	RegexParser::AtomNode atom{type, static_cast<uint32_t>(_strings.size()), static_cast<uint32_t>(value.size()), set};
+	_strings.append(value);
+	NodeId id = push(RegexParser::RegexNode{RegexParser::ATOM, atom});
+	_internedAtoms.emplace(std::move(key), id);
+	return id;
+}
+
+// the text of the first spelling is kept for printing
+RegexArena::NodeId RegexArena::addClass(std::string_view text, const CharSet &members) {
+	CharSetTable::SetId set = _sets.intern(members);
+	auto it = _internedClasses.find(set);
+	if (it != _internedClasses.end()) {
+		++_sharedHits;
+		return it->second;
+	}
+	RegexParser::AtomNode atom{RegexParser::CHARACTER_CLASS, static_cast<uint32_t>(_strings.size()), static_cast<uint32_t>(text.size()), set};
+	_strings.append(text);
+	NodeId id = push(RegexParser::RegexNode{RegexParser::ATOM, atom});
+	_internedClasses.emplace(set, id);
+	return id;
+}
+
+const RegexParser::RegexNode &RegexArena::getNode(NodeId id) const {
+	return _nodes[id];
+}
+
+std::string_view RegexArena::getValue(const RegexParser::AtomNode &atom) const {
+	return std::string_view(_strings).substr(atom.valueOffset, atom.valueLength);
+}
+
+const CharSet &RegexArena::getSet(CharSetTable::SetId id) const {
+	return _sets.get(id);
+}
+
+const CharSetTable &RegexArena::getSets() const {
+	return _sets;
+}
+
+void RegexArena::appendFactors(NodeId id, std::vector<NodeId> &factors) const {
+	const RegexParser::RegexNode &node = _nodes[id];
+	if (node.type == RegexParser::CONCATENATION) {
+		const auto &concat = std::get<RegexParser::ConcatenationNode>(node.data);
+		appendFactors(concat.left, factors);
+		appendFactors(concat.right, factors);
+		return;
+	}
+	factors.push_back(id);
+}
+
+size_t RegexArena::size() const {
+	return _nodes.size();
+}
+
+size_t RegexArena::bytesUsed() const {
+	return _nodes.capacity() * sizeof(RegexParser::RegexNode) + _strings.capacity() + _sets.bytesUsed();
+}
+
+size_t RegexArena::getSharedHits() const {
+	return _sharedHits;
+}
+
+void RegexArena::clear() {
+	_nodes.clear();
+	_strings.clear();
+	_internedNodes.clear();
+	_internedAtoms.clear();
+	_sets.clear();
+	_internedClasses.clear();
+	_sharedHits = 0;
+}
@@ -0,0 +1,383 @@
+#include "RegexOptimizer.hpp"
+#include "RegexArena.hpp"
+
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+
+RegexOptimizer::RegexOptimizer(RegexArena &arena)
+	: _arena(arena), _empty(arena.addAtom(RegexParser::STRING, "")) {}
+
+RegexOptimizer::~RegexOptimizer() {}
+
+RegexOptimizer::NodeId RegexOptimizer::optimize(NodeId root) {
+	if (root >= _optimized.size()) {
+		_optimized.resize(_arena.size(), RegexParser::NO_NODE);
+	}
+	if (_optimized[root] != RegexParser::NO_NODE) {
+		return _optimized[root];
+	}
+	NodeId result = rewrite(root);
+	// every node built here is already in normal form
+	if (result >= _optimized.size()) {
+		_optimized.resize(_arena.size(), RegexParser::NO_NODE);
+	}
+	_optimized[root] = result;
+	_optimized[result] = result;
+	return result;
+}
+
+RegexOptimizer::NodeId RegexOptimizer::rewrite(NodeId id) {
+	// copied: the arena may grow, and move its nodes, while rewriting
+	const RegexParser::RegexNode node = _arena.getNode(id);
+	switch (node.type) {
+		case RegexParser::ATOM: {
+			const auto &atom = std::get<RegexParser::AtomNode>(node.data);
+			if (atom.type == RegexParser::STRING && atom.valueLength == 1) {
+				return literal(std::string(_arena.getValue(atom)));
+			}
+			return id;
+		}
+		case RegexParser::CONCATENATION: {
+			const auto &concat = std::get<RegexParser::ConcatenationNode>(node.data);
+			std::vector<NodeId> factors;
+			_arena.appendFactors(optimize(concat.left), factors);
+			_arena.appendFactors(optimize(concat.right), factors);
+			return concatenate(factors);
+		}
+		case RegexParser::ALTERNATION: {
+			const auto &alt = std::get<RegexParser::AlternationNode>(node.data);
+			std::vector<NodeId> alternatives;
+			appendAlternatives(optimize(alt.left), alternatives);
+			appendAlternatives(optimize(alt.right), alternatives);
+			return alternate(alternatives);
+		}
+		case RegexParser::QUANTIFIER: {
+			const auto &quantifier = std::get<RegexParser::QuantifierNode>(node.data);
+			return quantify(optimize(quantifier.node), quantifier.quantifierType, quantifier.min, quantifier.max);
+		}
+	}
+	return id;
+}
+
+// Fuses runs of literals and drops empty strings.
+RegexOptimizer::NodeId RegexOptimizer::concatenate(const std::vector<NodeId> &factors) {
+	std::vector<NodeId> merged;
+	std::string text;
+	for (NodeId factor : factors) {
+		if (isLiteral(factor)) {
+			text += literalText(factor);
+			continue;
+		}
+		if (!text.empty()) {
+			merged.push_back(literal(text));
+			text.clear();
+		}
+		merged.push_back(factor);
+	}
+	if (!text.empty()) {
+		merged.push_back(literal(text));
+	}
+	if (merged.empty()) {
+		return _empty;
+	}
+	NodeId result = merged[0];
+	for (size_t i = 1; i < merged.size(); ++i) {
+		result = _arena.addNode(RegexParser::RegexNode{RegexParser::CONCATENATION, RegexParser::ConcatenationNode{result, merged[i]}});
+	}
+	return result;
+}
+
+// Alternatives are grouped by their first byte when they start with a
+// literal, by their first factor otherwise; each group shares its prefix.
+// The empty alternative turns the rest optional.
+RegexOptimizer::NodeId RegexOptimizer::alternate(const std::vector<NodeId> &alternatives) {
+	bool optional = false;
+	std::unordered_set<NodeId> seen;
+	std::vector<std::vector<std::vector<NodeId>>> groups;
+	std::unordered_map<uint64_t, size_t> groupOf;
+	for (NodeId alternative : alternatives) {
+		if (alternative == _empty) {
+			optional = true;
+			continue;
+		}
+		if (!seen.insert(alternative).second) {
+			continue;
+		}
+		std::vector<NodeId> factors;
+		_arena.appendFactors(alternative, factors);
+		uint64_t key = isLiteral(factors[0]) ? (1ULL << 32) | static_cast<uint8_t>(literalText(factors[0])[0]) : factors[0];
+		auto [it, inserted] = groupOf.try_emplace(key, groups.size());
+		if (inserted) {
+			groups.emplace_back();
+		}
+		groups[it->second].push_back(std::move(factors));
+	}
+
+	std::vector<NodeId> results;
+	CharSet bytes;
+	size_t byteAlternatives = 0;
+	size_t byteIndex = 0;
+	for (const auto &group : groups) {
+		NodeId result = group.size() == 1 ? concatenate(group[0]) : factorPrefixes(group);
+		CharSet set;
+		if (singleByte(result, set)) {
+			if (byteAlternatives++ == 0) {
+				byteIndex = results.size();
+				results.push_back(result);
+			}
+			bytes |= set;
+			continue;
+		}
+		results.push_back(result);
+	}
+	if (byteAlternatives > 1) {
+		results[byteIndex] = byteAtom(bytes);
+	}
+
+	if (results.empty()) {
+		return _empty;
+	}
+	NodeId result = results[0];
+	for (size_t i = 1; i < results.size(); ++i) {
+		result = _arena.addNode(RegexParser::RegexNode{RegexParser::ALTERNATION, RegexParser::AlternationNode{result, results[i]}});
+	}
+	if (optional) {
+		result = quantify(result, RegexParser::OPTIONAL, -1, -1);
+	}
+	return result;
+}
+
+// group holds the factors of two or more alternatives with the same head
+RegexOptimizer::NodeId RegexOptimizer::factorPrefixes(const std::vector<std::vector<NodeId>> &group) {
+	std::vector<NodeId> prefix;
+	std::vector<NodeId> rests;
+	if (isLiteral(group[0][0])) {
+		std::string head(literalText(group[0][0]));
+		size_t length = head.size();
+		for (const auto &factors : group) {
+			std::string_view other = literalText(factors[0]);
+			size_t common = 0;
+			while (common < length && common < other.size() && other[common] == head[common]) {
+				++common;
+			}
+			length = common;
+		}
+		prefix.push_back(literal(head.substr(0, length)));
+		for (const auto &factors : group) {
+			std::vector<NodeId> rest;
+			std::string tail(literalText(factors[0]).substr(length));
+			if (!tail.empty()) {
+				rest.push_back(literal(tail));
+			}
+			rest.insert(rest.end(), factors.begin() + 1, factors.end());
+			rests.push_back(concatenate(rest));
+		}
+	} else {
+		size_t length = group[0].size();
+		for (const auto &factors : group) {
+			size_t common = 0;
+			while (common < length && common < factors.size() && factors[common] == group[0][common]) {
+				++common;
+			}
+			length = common;
+		}
+		prefix.assign(group[0].begin(), group[0].begin() + static_cast<long>(length));
+		for (const auto &factors : group) {
+			rests.push_back(concatenate(std::vector<NodeId>(factors.begin() + static_cast<long>(length), factors.end())));
+		}
+	}
+	prefix.push_back(alternate(rests));
+	return concatenate(prefix);
+}
+
+// x** = x*, x+* = x?* = x*+ = x*? = x+? = x?+ = x*; counted repetitions with
+// a plain equivalent become one.
+RegexOptimizer::NodeId RegexOptimizer::quantify(NodeId inner, RegexParser::QuantifierType type, int min, int max) {
+	if (inner == _empty || type == RegexParser::NONE) {
+		return inner;
+	}
+	if (type == RegexParser::RANGE) {
+		if (max == 0) {
+			return _empty;
+		}
+		if (min == 1 && max == 1) {
+			return inner;
+		}
+		if (min == 0 && max == 1) {
+			type = RegexParser::OPTIONAL;
+		} else if (min == 0 && max == RegexParser::UNBOUNDED) {
+			type = RegexParser::STAR;
+		} else if (min == 1 && max == RegexParser::UNBOUNDED) {
+			type = RegexParser::PLUS;
+		}
+	}
+	const RegexParser::RegexNode &node = _arena.getNode(inner);
+	if (node.type == RegexParser::QUANTIFIER) {
+		RegexParser::QuantifierNode nested = std::get<RegexParser::QuantifierNode>(node.data);
+		if (nested.quantifierType == RegexParser::STAR) {
+			return inner;
+		}
+		if (type != RegexParser::RANGE && nested.quantifierType != RegexParser::RANGE) {
+			if (nested.quantifierType == type) {
+				return inner;
+			}
+			return quantify(nested.node, RegexParser::STAR, -1, -1);
+		}
+	}
+	if (type == RegexParser::RANGE) {
+		return _arena.addNode(RegexParser::RegexNode{RegexParser::QUANTIFIER, RegexParser::QuantifierNode{inner, type, min, max}});
+	}
+	if (nullable(inner)) {
+		if (type == RegexParser::OPTIONAL) {
+			return inner;
+		}
+		type = RegexParser::STAR;
+	}
+	return _arena.addNode(RegexParser::RegexNode{RegexParser::QUANTIFIER, RegexParser::QuantifierNode{inner, type, -1, -1}});
+}
+
+void RegexOptimizer::appendAlternatives(NodeId id, std::vector<NodeId> &alternatives) const {
+	const RegexParser::RegexNode &node = _arena.getNode(id);
+	if (node.type == RegexParser::ALTERNATION) {
+		const auto &alt = std::get<RegexParser::AlternationNode>(node.data);
+		appendAlternatives(alt.left, alternatives);
+		appendAlternatives(alt.right, alternatives);
+		return;
+	}
+	alternatives.push_back(id);
+}
+
+bool RegexOptimizer::isLiteral(NodeId id) const {
+	const RegexParser::RegexNode &node = _arena.getNode(id);
+	if (node.type != RegexParser::ATOM) {
+		return false;
+	}
+	RegexParser::AtomType type = std::get<RegexParser::AtomNode>(node.data).type;
+	return type == RegexParser::CHARACTER || type == RegexParser::STRING;
+}
+
+// only valid until the arena grows
+std::string_view RegexOptimizer::literalText(NodeId id) const {
+	return _arena.getValue(std::get<RegexParser::AtomNode>(_arena.getNode(id).data));
+}
+
+RegexOptimizer::NodeId RegexOptimizer::literal(std::string_view text) {
+	return _arena.addAtom(text.size() == 1 ? RegexParser::CHARACTER : RegexParser::STRING, text);
+}
+
+bool RegexOptimizer::singleByte(NodeId id, CharSet &bytes) const {
+	const RegexParser::RegexNode &node = _arena.getNode(id);
+	if (node.type != RegexParser::ATOM) {
+		return false;
+	}
+	const auto &atom = std::get<RegexParser::AtomNode>(node.data);
+	if (atom.set == CharSetTable::NO_SET) {
+		return false;
+	}
+	bytes = _arena.getSet(atom.set);
+	return true;
+}
+
+RegexOptimizer::NodeId RegexOptimizer::byteAtom(const CharSet &bytes) {
+	if (bytes.count() == 1) {
+		return literal(std::string(1, static_cast<char>(bytes.first())));
+	}
+	return _arena.addClass(classText(bytes), bytes);
+}
+
+bool RegexOptimizer::nullable(NodeId id) {
+	if (id >= _nullable.size()) {
+		_nullable.resize(_arena.size(), -1);
+	}
+	if (_nullable[id] >= 0) {
+		return _nullable[id];
+	}
+	const RegexParser::RegexNode node = _arena.getNode(id);
+	bool result = false;
+	switch (node.type) {
+		case RegexParser::ATOM:
+			result = std::get<RegexParser::AtomNode>(node.data).valueLength == 0
+				&& std::get<RegexParser::AtomNode>(node.data).type == RegexParser::STRING;
+			break;
+		case RegexParser::CONCATENATION: {
+			const auto &concat = std::get<RegexParser::ConcatenationNode>(node.data);
+			result = nullable(concat.left) && nullable(concat.right);
+			break;
+		}
+		case RegexParser::ALTERNATION: {
+			const auto &alt = std::get<RegexParser::AlternationNode>(node.data);
+			result = nullable(alt.left) || nullable(alt.right);
+			break;
+		}
+		case RegexParser::QUANTIFIER: {
+			const auto &quantifier = std::get<RegexParser::QuantifierNode>(node.data);
+			result = quantifier.quantifierType == RegexParser::STAR || quantifier.quantifierType == RegexParser::OPTIONAL
+				|| (quantifier.quantifierType == RegexParser::RANGE && quantifier.min == 0) || nullable(quantifier.node);
+			break;
+		}
+	}
+	_nullable[id] = result;
+	return result;
+}
+
+// text that decodeClass() reads back as bytes, for printing
+std::string RegexOptimizer::classText(const CharSet &bytes) {
+	static constexpr char HEX[] = "0123456789abcdef";
+	std::string text;
+	auto put = [&](uint8_t c) {
+		if (c > ' ' && c < 0x7F && c != '\\' && c != ']' && c != '^' && c != '-') {
+			text += static_cast<char>(c);
+		} else {
+			text += "\\x";
+			text += HEX[c >> 4];
+			text += HEX[c & 15];
+		}
+	};
+	bytes.forEachRange([&](uint8_t lo, uint8_t hi) {
+		put(lo);
+		if (hi > lo + 1) {
+			text += '-';
+		}
+		if (hi > lo) {
+			put(hi);
+		}
+	});
+	return text;
+}
+
+size_t RegexOptimizer::countNodes(const RegexArena &arena, const std::vector<NodeId> &roots) {
+	// children have lower ids, so one pass in id order sees them first
+	NodeId highest = 0;
+	for (NodeId root : roots) {
+		highest = std::max(highest, root);
+	}
+	std::vector<size_t> size(roots.empty() ? 0 : highest + 1, 0);
+	auto add = [](size_t a, size_t b) { return a > SIZE_MAX - b ? SIZE_MAX : a + b; };
+	for (NodeId id = 0; id < size.size(); ++id) {
+		const RegexParser::RegexNode &node = arena.getNode(id);
+		switch (node.type) {
+			case RegexParser::ATOM:
+				size[id] = 1;
+				break;
+			case RegexParser::CONCATENATION: {
+				const auto &concat = std::get<RegexParser::ConcatenationNode>(node.data);
+				size[id] = add(1, add(size[concat.left], size[concat.right]));
+				break;
+			}
+			case RegexParser::ALTERNATION: {
+				const auto &alt = std::get<RegexParser::AlternationNode>(node.data);
+				size[id] = add(1, add(size[alt.left], size[alt.right]));
+				break;
+			}
+			case RegexParser::QUANTIFIER:
+				size[id] = add(1, size[std::get<RegexParser::QuantifierNode>(node.data).node]);
+				break;
+		}
+	}
+	size_t total = 0;
+	for (NodeId root : roots) {
+		total = add(total, size[root]);
+	}
+	return total;
+}
@@ -1,48 +1,20 @@
 #include "RegexParser.hpp"
+#include "RegexArena.hpp"
+#include "SubstitutionCache.hpp"
 
 #include <iostream>
-#include <sstream>
 
-RegexParser::RegexParser(const std::string &pattern, const std::map<std::string, std::string> &substitutions)
-	: _pattern(pattern), _substitutions(substitutions) {}
+RegexParser::RegexParser(std::string_view pattern, SubstitutionCache &substitutions, RegexArena &arena)
+	: _pattern(pattern), _substitutions(substitutions), _arena(arena) {}
 
-void freeNode(RegexParser::RegexNode *node) {
-	if (node == nullptr) {
-		return;
-	}
-	switch (node->type) {
-		case RegexParser::ATOM: {
-			break;
-		}
-		case RegexParser::CONCATENATION: {
-			RegexParser::ConcatenationNode &concat = std::get<RegexParser::ConcatenationNode>(node->data);
-			freeNode(concat.left);
-			freeNode(concat.right);
-			break;
-		}
-		case RegexParser::ALTERNATION: {
-			RegexParser::AlternationNode &alt = std::get<RegexParser::AlternationNode>(node->data);
-			freeNode(alt.left);
-			freeNode(alt.right);
-			break;
-		}
-		case RegexParser::QUANTIFIER: {
-			RegexParser::QuantifierNode &quant = std::get<RegexParser::QuantifierNode>(node->data);
-			freeNode(quant.node);
-			break;
-		}
-	}
-	delete node;
-}
-
-RegexParser::~RegexParser() {
-	// freeNode(_root);
-}
+RegexParser::~RegexParser() {}
 
 bool RegexParser::parse() {
-	std::cout << "Parsing regex pattern: " << _pattern << std::endl;
 	_position = 0;
 	_root = parseAlternation();
+	if (_position != _pattern.size()) {
+		throw std::runtime_error(std::string("Unexpected '") + peek() + "' at position " + std::to_string(_position));
+	}
 	return true;
 }
 
@@ -61,105 +33,230 @@ void RegexParser::consume(char expected) {
 }
 
 bool RegexParser::canStartAtom(char c) const {
-	return (isalnum(c) || c == '.' || c == '[' || c == '(' || c == '{' || c == '\"');
+	if (_position >= _pattern.size()) {
+		return false;
+	}
+	return (c != '|' && c != ')' && c != '*' && c != '+' && c != '?');
+}
+
+bool RegexParser::atEnd() const {
+	return _position >= _pattern.size();
 }
 
-RegexParser::RegexNode* RegexParser::parseAlternation() {
-	RegexParser::RegexNode* left = this->parseConcatenation();
+char RegexParser::decodeEscape(std::string_view text, size_t &position) {
+	if (position >= text.size()) {
+		throw std::runtime_error("Trailing backslash in pattern");
+	}
+	char c = text[position++];
+	switch (c) {
+		case 'n': return '\n';
+		case 't': return '\t';
+		case 'r': return '\r';
+		case 'f': return '\f';
+		case 'v': return '\v';
+		case 'a': return '\a';
+		case 'b': return '\b';
+		case 'x': {
+			int value = 0;
+			int digits = 0;
+			while (digits < 2 && position < text.size() && isxdigit(static_cast<unsigned char>(text[position]))) {
+				char d = text[position++];
+				value = value * 16 + (isdigit(static_cast<unsigned char>(d)) ? d - '0' : (tolower(d) - 'a' + 10));
+				digits++;
+			}
+			if (digits == 0) {
+				throw std::runtime_error("Invalid hexadecimal escape in pattern");
+			}
+			return static_cast<char>(value);
+		}
+		default:
+			break;
+	}
+	if (c >= '0' && c <= '7') {
+		int value = c - '0';
+		int digits = 1;
+		while (digits < 3 && position < text.size() && text[position] >= '0' && text[position] <= '7') {
+			value = value * 8 + (text[position++] - '0');
+			digits++;
+		}
+		return static_cast<char>(value);
+	}
+	return c;
+}
+
+CharSet RegexParser::decodeClass(std::string_view text) {
+	CharSet members;
+	size_t pos = 0;
+	bool negated = false;
+	if (pos < text.size() && text[pos] == '^') {
+		negated = true;
+		++pos;
+	}
+	while (pos < text.size()) {
+		unsigned char lo = static_cast<unsigned char>(text[pos++]);
+		if (lo == '\\') {
+			lo = static_cast<unsigned char>(decodeEscape(text, pos));
+		}
+		unsigned char hi = lo;
+		if (pos + 1 < text.size() && text[pos] == '-') {
+			++pos;
+			hi = static_cast<unsigned char>(text[pos++]);
+			if (hi == '\\') {
+				hi = static_cast<unsigned char>(decodeEscape(text, pos));
+			}
+			if (hi < lo) {
+				throw std::runtime_error("Invalid range in character class [" + std::string(text) + "]");
+			}
+		}
+		members.addRange(lo, hi);
+	}
+	return negated ? ~members : members;
+}
+
+char RegexParser::parseEscape() {
+	this->consume('\\');
+	return decodeEscape(_pattern, _position);
+}
+
+RegexParser::NodeId RegexParser::parseAlternation() {
+	RegexParser::NodeId left = this->parseConcatenation();
 
 	while (this->peek() == '|') {
 		this->consume('|');
-		RegexParser::RegexNode* right = this->parseConcatenation();
+		RegexParser::NodeId right = this->parseConcatenation();
 
-		left = new RegexParser::RegexNode{RegexParser::ALTERNATION, RegexParser::AlternationNode{left, right}};
+		left = _arena.addNode(RegexParser::RegexNode{RegexParser::ALTERNATION, RegexParser::AlternationNode{left, right}});
 	}
 
 	return left;
 }
 
-RegexParser::RegexNode* RegexParser::parseConcatenation() {
-	RegexParser::RegexNode* left = this->parseQuantifier();
+RegexParser::NodeId RegexParser::parseConcatenation() {
+	RegexParser::NodeId left = this->parseQuantifier();
 
 	while (canStartAtom(this->peek())) {
-		RegexParser::RegexNode* right = this->parseQuantifier();
+		RegexParser::NodeId right = this->parseQuantifier();
 
-		left = new RegexParser::RegexNode{RegexParser::CONCATENATION, RegexParser::ConcatenationNode{left, right}};
+		left = _arena.addNode(RegexParser::RegexNode{RegexParser::CONCATENATION, RegexParser::ConcatenationNode{left, right}});
 	}
 
 	return left;
 }
 
-RegexParser::RegexNode* RegexParser::parseQuantifier() {
-	RegexParser::RegexNode* atom = this->parseAtom();
+RegexParser::NodeId RegexParser::parseQuantifier() {
+	RegexParser::NodeId atom = this->parseAtom();
 
 	if (this->peek() == '*') {
 		this->consume('*');
-		return new RegexParser::RegexNode{RegexParser::QUANTIFIER, RegexParser::QuantifierNode{atom, RegexParser::STAR, -1, -1}};
+		return _arena.addNode(RegexParser::RegexNode{RegexParser::QUANTIFIER, RegexParser::QuantifierNode{atom, RegexParser::STAR, -1, -1}});
 	} else if (this->peek() == '+') {
 		this->consume('+');
-		return new RegexParser::RegexNode{RegexParser::QUANTIFIER, RegexParser::QuantifierNode{atom, RegexParser::PLUS, -1, -1}};
+		return _arena.addNode(RegexParser::RegexNode{RegexParser::QUANTIFIER, RegexParser::QuantifierNode{atom, RegexParser::PLUS, -1, -1}});
 	} else if (this->peek() == '?') {
 		this->consume('?');
-		return new RegexParser::RegexNode{RegexParser::QUANTIFIER, RegexParser::QuantifierNode{atom, RegexParser::OPTIONAL, -1, -1}};
-	} else if (this->peek() == '{') {
+		return _arena.addNode(RegexParser::RegexNode{RegexParser::QUANTIFIER, RegexParser::QuantifierNode{atom, RegexParser::OPTIONAL, -1, -1}});
+	} else if (this->peek() == '{' && _position + 1 < _pattern.size() && isdigit(static_cast<unsigned char>(_pattern[_position + 1]))) {
+		// {n}, {m,} or {m,n}; a '{' followed by anything else starts a
+		// {NAME} substitution, the next atom of the concatenation
 		this->consume('{');
-		std::string rangeContent;
-		while (true) {
-			char c = this->peek();
-			if (c == '}') {
-				this->consume('}');
-				break;
-			}
-			rangeContent += c;
-			this->consume(c);
-		}
-		std::istringstream iss(rangeContent);
-		std::string token;
-		int min = 0, max = 0;
-		if (std::getline(iss, token, ',')) {
-			min = std::stoi(token);
+		int min = parseCount();
+		int max = min;
+		if (this->peek() == ',') {
+			this->consume(',');
+			max = this->peek() == '}' ? UNBOUNDED : parseCount();
 		}
-		if (std::getline(iss, token)) {
-			max = std::stoi(token);
+		this->consume('}');
+		if (max != UNBOUNDED && max < min) {
+			throw std::runtime_error("Invalid repetition {" + std::to_string(min) + "," + std::to_string(max) + "}");
 		}
-		return new RegexParser::RegexNode{RegexParser::QUANTIFIER, RegexParser::QuantifierNode{atom, RegexParser::RANGE, min, max}};
+		return makeRange(atom, min, max);
 	}
 
 	return atom;
 }
 
-RegexParser::RegexNode* RegexParser::parseAtom() {
+// (x{a,b}){c,d} repeats x between k*a and k*b times for some k in [c,d]. When
+// those intervals leave no gap it is x{ac,bd}, one range to lower instead of
+// d copies of b copies. The intervals of k and k + 1 touch when
+// (k + 1) * a <= k * b + 1, which only gets easier as k grows, so checking
+// k = c is enough.
+RegexParser::NodeId RegexParser::makeRange(NodeId atom, int min, int max) {
+	const RegexNode &inner = _arena.getNode(atom);
+	if (inner.type == QUANTIFIER && std::get<QuantifierNode>(inner.data).quantifierType == RANGE && max != 0) {
+		QuantifierNode range = std::get<QuantifierNode>(inner.data);
+		long long a = range.min;
+		long long b = range.max;
+		long long c = min;
+		long long d = max;
+		bool contiguous = (d == c) || (b == UNBOUNDED ? (c >= 1 || a <= 1) : (c + 1) * a <= c * b + 1);
+		bool unbounded = (b == UNBOUNDED || d == UNBOUNDED);
+		if (b != 0 && contiguous && a * c <= MAX_REPETITION && (unbounded || b * d <= MAX_REPETITION)) {
+			return _arena.addNode(RegexNode{QUANTIFIER, QuantifierNode{range.node,
+				RANGE, static_cast<int>(a * c), unbounded ? UNBOUNDED : static_cast<int>(b * d)}});
+		}
+	}
+	return _arena.addNode(RegexNode{QUANTIFIER, QuantifierNode{atom, RANGE, min, max}});
+}
+
+int RegexParser::parseCount() {
+	if (!isdigit(static_cast<unsigned char>(this->peek()))) {
+		throw std::runtime_error(std::string("Expected a repetition count, but found '") + peek() + "'");
+	}
+	int count = 0;
+	while (isdigit(static_cast<unsigned char>(this->peek()))) {
+		count = count * 10 + (this->peek() - '0');
+		if (count > MAX_REPETITION) {
+			throw std::runtime_error("Repetition count over " + std::to_string(MAX_REPETITION));
+		}
+		this->consume(this->peek());
+	}
+	return count;
+}
+
+RegexParser::NodeId RegexParser::parseAtom() {
 	if (this->peek() == '(') {
 		this->consume('(');
-		RegexParser::RegexNode* subExpr = this->parseAlternation();
+		RegexParser::NodeId subExpr = this->parseAlternation();
 		this->consume(')');
 		return subExpr;
 	}
 
 	if (this->peek() == '.') {
 		this->consume('.');
-		return new RegexParser::RegexNode{RegexParser::ATOM, RegexParser::AtomNode{RegexParser::WILDCARD, "."}};
+		return makeAtom(RegexParser::WILDCARD, ".");
 	}
 
 	if (this->peek() == '[') {
 		this->consume('[');
 		std::string classContent;
 		while (true) {
+			if (atEnd()) {
+				throw std::runtime_error("Unterminated character class");
+			}
 			char c = this->peek();
-			if (c == ']') {
+			if (c == ']' && !classContent.empty() && classContent != "^") {
 				this->consume(']');
 				break;
 			}
+			if (c == '\\' && _position + 1 < _pattern.size()) {
+				// keep escapes verbatim, the class is decoded by later stages
+				classContent += c;
+				this->consume(c);
+				c = this->peek();
+			}
 			classContent += c;
 			this->consume(c);
 		}
-		return new RegexParser::RegexNode{RegexParser::ATOM, RegexParser::AtomNode{RegexParser::CHARACTER_CLASS, classContent}};
+		return _arena.addClass(classContent, decodeClass(classContent));
 	}
 
 	if (this->peek() == '{') {
 		this->consume('{');
 		std::string substitutionContent;
 		while (true) {
+			if (atEnd()) {
+				throw std::runtime_error("Unterminated substitution reference");
+			}
 			char c = this->peek();
 			if (c == '}') {
 				this->consume('}');
@@ -168,36 +265,48 @@ RegexParser::RegexNode* RegexParser::parseAtom() {
 			substitutionContent += c;
 			this->consume(c);
 		}
-		if (_substitutions.find(substitutionContent) == _substitutions.end()) {
-			// TODO improve
-			throw std::runtime_error("Undefined substitution: " + substitutionContent);
-		}
-		RegexParser subParser(_substitutions[substitutionContent], _substitutions);
-		subParser.parse();
-		return subParser.getRoot();
+		return _substitutions.resolve(substitutionContent);
 	}
 
 	if (this->peek() == '\"') {
 		this->consume('\"');
 		std::string stringContent;
 		while (true) {
+			if (atEnd()) {
+				throw std::runtime_error("Unterminated string");
+			}
 			char c = this->peek();
 			if (c == '\"') {
 				this->consume('\"');
 				break;
 			}
+			if (c == '\\') {
+				stringContent += parseEscape();
+				continue;
+			}
 			stringContent += c;
 			this->consume(c);
 		}
-		return new RegexParser::RegexNode{RegexParser::ATOM, RegexParser::AtomNode{RegexParser::STRING, stringContent}};
+		return makeAtom(RegexParser::STRING, stringContent);
+	}
+
+	if (this->peek() == '\\') {
+		return makeAtom(RegexParser::CHARACTER, std::string(1, parseEscape()));
 	}
 
+	if (atEnd()) {
+		throw std::runtime_error("Unexpected end of pattern");
+	}
 	char c = this->peek();
 	this->consume(c);
-	return new RegexParser::RegexNode{RegexParser::ATOM, RegexParser::AtomNode{RegexParser::CHARACTER, std::string(1, c)}};
+	return makeAtom(RegexParser::CHARACTER, std::string(1, c));
+}
+
+RegexParser::NodeId RegexParser::makeAtom(AtomType type, const std::string &value) {
+	return _arena.addAtom(type, value);
 }
 
-RegexParser::RegexNode* RegexParser::getRoot() const {
+RegexParser::NodeId RegexParser::getRoot() const {
 	return _root;
 }
 
@@ -207,17 +316,18 @@ static void printPrefix(int indent) {
     std::cout << "|- ";
 }
 
-void RegexParser::printNode(const RegexNode* node, int indent) const {
-    if (!node) {
+void RegexParser::printNode(NodeId id, int indent) const {
+    if (id == NO_NODE) {
         printPrefix(indent);
         std::cout << "(null)\n";
         return;
     }
 
-    switch (node->type) {
+    const RegexNode &node = _arena.getNode(id);
+    switch (node.type) {
 
 		case ATOM: {
-			const AtomNode& atom = std::get<AtomNode>(node->data);
+			const AtomNode& atom = std::get<AtomNode>(node.data);
 			printPrefix(indent);
 			std::cout << "ATOM ";
 
@@ -226,13 +336,13 @@ void RegexParser::printNode(const RegexNode* node, int indent) const {
 				std::cout << ".";
 				break;
 			case CHARACTER:
-				std::cout << "'" << atom.value << "'";
+				std::cout << "'" << _arena.getValue(atom) << "'";
 				break;
 			case CHARACTER_CLASS:
-				std::cout << "[" << atom.value << "]";
+				std::cout << "[" << _arena.getValue(atom) << "]";
 				break;
 			case STRING:
-				std::cout << "\"" << atom.value << "\"";
+				std::cout << "\"" << _arena.getValue(atom) << "\"";
 				break;
 			}
 			std::cout << "\n";
@@ -240,7 +350,7 @@ void RegexParser::printNode(const RegexNode* node, int indent) const {
 		}
 
 		case CONCATENATION: {
-			const auto& c = std::get<ConcatenationNode>(node->data);
+			const auto& c = std::get<ConcatenationNode>(node.data);
 			printPrefix(indent);
 			std::cout << "CONCAT\n";
 			printNode(c.left, indent + 1);
@@ -249,7 +359,7 @@ void RegexParser::printNode(const RegexNode* node, int indent) const {
 		}
 
 		case ALTERNATION: {
-			const auto& a = std::get<AlternationNode>(node->data);
+			const auto& a = std::get<AlternationNode>(node.data);
 			printPrefix(indent);
 			std::cout << "ALT\n";
 			printNode(a.left, indent + 1);
@@ -258,7 +368,7 @@ void RegexParser::printNode(const RegexNode* node, int indent) const {
 		}
 
 		case QUANTIFIER: {
-			const auto& q = std::get<QuantifierNode>(node->data);
+			const auto& q = std::get<QuantifierNode>(node.data);
 			printPrefix(indent);
 
 			switch (q.quantifierType) {
@@ -272,7 +382,11 @@ void RegexParser::printNode(const RegexNode* node, int indent) const {
 				std::cout << "OPTIONAL\n";
 				break;
 			case RANGE:
-				std::cout << "RANGE {" << q.min << "," << q.max << "}\n";
+				if (q.max == UNBOUNDED) {
+					std::cout << "RANGE {" << q.min << ",}\n";
+				} else {
+					std::cout << "RANGE {" << q.min << "," << q.max << "}\n";
+				}
 				break;
 			case NONE:
 				std::cout << "NONE\n";
@@ -290,8 +404,8 @@ void RegexParser::printNode(const RegexNode* node, int indent) const {
 }
 
 void RegexParser::printTree() const {
-	RegexNode* root = _root;
-	if (root == nullptr) {
+	NodeId root = _root;
+	if (root == NO_NODE) {
 		std::cout << "Empty regex tree." << std::endl;
 		return;
 	}
@@ -0,0 +1,194 @@
+#include "Stats.hpp"
+
+#include <atomic>
+#include <cctype>
+#include <cstdlib>
+#include <iomanip>
+#include <new>
+#include <sstream>
+
+#include <sys/resource.h>
+
+static std::atomic<bool> countingAllocations{ false };
+static std::atomic<size_t> allocationCount{ 0 };
+static std::atomic<size_t> allocatedBytes{ 0 };
+
+// The replaceable global allocation function, counting while asked to. The
+// array and nothrow forms call this one, and the matching deallocation
+// functions only have to free.
+void *operator new(std::size_t size) {
+	if (countingAllocations.load(std::memory_order_relaxed)) {
+		allocationCount.fetch_add(1, std::memory_order_relaxed);
+		allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+	}
+	void *block;
+	while ((block = std::malloc(size ? size : 1)) == nullptr) {
+		std::new_handler handler = std::get_new_handler();
+		if (!handler) {
+			throw std::bad_alloc();
+		}
+		handler();
+	}
+	return block;
+}
+
+void operator delete(void *block) noexcept {
+	std::free(block);
+}
+
+void operator delete(void *block, std::size_t) noexcept {
+	std::free(block);
+}
+
+Stats::Timer::Timer(Stats *stats, const char *stage) : _stats(stats), _stage(stage) {
+	if (_stats) {
+		_allocations = getAllocationCount();
+		_bytes = getAllocatedBytes();
+		_start = std::chrono::steady_clock::now();
+	}
+}
+
+Stats::Timer::~Timer() {
+	stop();
+}
+
+void Stats::Timer::stop() {
+	if (!_stats) {
+		return;
+	}
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - _start;
+	_stats->_stages.push_back({ _stage, elapsed.count(), getAllocationCount() - _allocations, getAllocatedBytes() - _bytes });
+	_stats = nullptr;
+}
+
+Stats::Stats() {}
+
+Stats::~Stats() {}
+
+void Stats::add(const std::string &name, size_t value, const std::string &unit) {
+	_counters.push_back({ name, std::to_string(value), unit, false });
+}
+
+void Stats::add(const std::string &name, double value, const std::string &unit) {
+	std::ostringstream text;
+	text << std::fixed << std::setprecision(3) << value;
+	_counters.push_back({ name, text.str(), unit, false });
+}
+
+void Stats::add(const std::string &name, const std::string &text) {
+	_counters.push_back({ name, text, "", true });
+}
+
+void Stats::addLimit(const std::string &directive, const std::string &name, size_t used, size_t limit) {
+	_limits.push_back({ directive, name, used, limit });
+}
+
+void Stats::addPeakMemory() {
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0) {
+		return;
+	}
+#ifdef __APPLE__
+	add("Peak RSS", static_cast<size_t>(usage.ru_maxrss) / 1024, "KiB");
+#else
+	add("Peak RSS", static_cast<size_t>(usage.ru_maxrss), "KiB");
+#endif
+}
+
+void Stats::countAllocations() {
+	countingAllocations.store(true, std::memory_order_relaxed);
+}
+
+size_t Stats::getAllocationCount() {
+	return allocationCount.load(std::memory_order_relaxed);
+}
+
+size_t Stats::getAllocatedBytes() {
+	return allocatedBytes.load(std::memory_order_relaxed);
+}
+
+void Stats::write(std::ostream &out, Format format) const {
+	if (format == JSON) {
+		writeJson(out);
+	} else {
+		writeText(out);
+	}
+}
+
+void Stats::writeText(std::ostream &out) const {
+	out << std::fixed << std::setprecision(3);
+	out << "Stages:\n";
+	for (const Stage &stage : _stages) {
+		out << "  " << stage.name << ": " << stage.milliseconds << " ms, " << stage.allocations << " allocations, "
+			<< stage.bytes << " bytes\n";
+	}
+	for (const Counter &counter : _counters) {
+		out << counter.name << ": " << counter.value << (counter.unit.empty() ? "" : " ") << counter.unit << "\n";
+	}
+	if (!_limits.empty()) {
+		out << "Limits:\n";
+	}
+	out << std::setprecision(1);
+	for (const Limit &limit : _limits) {
+		out << "  " << limit.directive << " " << limit.name << ": " << limit.used << " of " << limit.limit << " ("
+			<< 100.0 * static_cast<double>(limit.used) / static_cast<double>(limit.limit) << "%)"
+			<< (limit.used > limit.limit ? ", over the limit" : "") << "\n";
+	}
+	out << std::flush;
+}
+
+// a JSON string literal of text
+static std::string jsonString(const std::string &text) {
+	std::ostringstream literal;
+	literal << '"';
+	for (char ch : text) {
+		if (ch == '"' || ch == '\\') {
+			literal << '\\' << ch;
+		} else if (static_cast<unsigned char>(ch) < 0x20) {
+			literal << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(ch) << std::dec;
+		} else {
+			literal << ch;
+		}
+	}
+	literal << '"';
+	return literal.str();
+}
+
+// "Peak RSS" in KiB becomes peak_rss_kib
+static std::string jsonKey(const std::string &name, const std::string &unit) {
+	std::string key;
+	for (char ch : unit.empty() ? name : name + " " + unit) {
+		if (std::isalnum(static_cast<unsigned char>(ch))) {
+			key += static_cast<char>(std::tolower(static_cast<unsigned char>(ch)));
+		} else if (!key.empty() && key.back() != '_') {
+			key += '_';
+		}
+	}
+	while (!key.empty() && key.back() == '_') {
+		key.pop_back();
+	}
+	return key;
+}
+
+void Stats::writeJson(std::ostream &out) const {
+	out << std::fixed << std::setprecision(3);
+	out << "{\n\t\"stages\": [";
+	for (size_t i = 0; i < _stages.size(); ++i) {
+		const Stage &stage = _stages[i];
+		out << (i ? ",\n\t\t" : "\n\t\t") << "{ \"name\": " << jsonString(stage.name) << ", \"ms\": " << stage.milliseconds
+			<< ", \"allocations\": " << stage.allocations << ", \"bytes\": " << stage.bytes << " }";
+	}
+	out << "\n\t],\n\t\"counters\": {";
+	for (size_t i = 0; i < _counters.size(); ++i) {
+		const Counter &counter = _counters[i];
+		out << (i ? ",\n\t\t" : "\n\t\t") << jsonString(jsonKey(counter.name, counter.unit)) << ": "
+			<< (counter.quoted ? jsonString(counter.value) : counter.value);
+	}
+	out << "\n\t},\n\t\"limits\": [";
+	for (size_t i = 0; i < _limits.size(); ++i) {
+		const Limit &limit = _limits[i];
+		out << (i ? ",\n\t\t" : "\n\t\t") << "{ \"directive\": " << jsonString(limit.directive) << ", \"name\": "
+			<< jsonString(limit.name) << ", \"used\": " << limit.used << ", \"limit\": " << limit.limit << " }";
+	}
+	out << "\n\t]\n}" << std::endl;
+}
@@ -0,0 +1,42 @@
+#include "SubstitutionCache.hpp"
+
+#include <stdexcept>
+
+SubstitutionCache::SubstitutionCache(const std::map<std::string_view, std::string_view> &substitutions, RegexArena &arena)
+	: _substitutions(substitutions), _arena(arena) {}
+
+SubstitutionCache::~SubstitutionCache() {}
+
+SubstitutionCache::NodeId SubstitutionCache::resolve(const std::string &name) {
+	auto it = _entries.find(name);
+	if (it != _entries.end()) {
+		if (it->second.state == IN_PROGRESS) {
+			throw std::runtime_error("Recursive substitution: " + name);
+		}
+		++_hits;
+		return it->second.root;
+	}
+	auto definition = _substitutions.find(name);
+	if (definition == _substitutions.end()) {
+		throw std::runtime_error("Undefined substitution: " + name);
+	}
+	++_misses;
+	_entries[name] = { IN_PROGRESS, RegexParser::NO_NODE };
+	RegexParser subParser(definition->second, *this, _arena);
+	try {
+		subParser.parse();
+	} catch (...) {
+		_entries.erase(name);
+		throw;
+	}
+	_entries[name] = { DONE, subParser.getRoot() };
+	return subParser.getRoot();
+}
+
+size_t SubstitutionCache::getHits() const {
+	return _hits;
+}
+
+size_t SubstitutionCache::getMisses() const {
+	return _misses;
+}
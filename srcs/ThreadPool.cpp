@@ -0,0 +1,93 @@
+#include "ThreadPool.hpp"
+
+ThreadPool::ThreadPool(size_t threadCount) {
+	if (threadCount == 0) {
+		threadCount = 1;
+	}
+	for (size_t i = 0; i < threadCount; ++i) {
+		_queues.push_back(std::make_unique<Queue>());
+	}
+	for (size_t i = 0; i < threadCount; ++i) {
+		_threads.emplace_back(&ThreadPool::workerLoop, this, i);
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stopping = true;
+	}
+	_wake.notify_all();
+	for (auto &thread : _threads) {
+		thread.join();
+	}
+}
+
+void ThreadPool::submit(Task task) {
+	std::lock_guard<std::mutex> lock(_mutex);
+	Queue &queue = *_queues[_nextQueue];
+	_nextQueue = (_nextQueue + 1) % _queues.size();
+	{
+		std::lock_guard<std::mutex> queueLock(queue.mutex);
+		queue.tasks.push_back(std::move(task));
+	}
+	++_queued;
+	++_pending;
+	_wake.notify_one();
+}
+
+void ThreadPool::wait() {
+	std::unique_lock<std::mutex> lock(_mutex);
+	_idle.wait(lock, [this] { return _pending == 0; });
+}
+
+bool ThreadPool::popTask(size_t worker, Task &task) {
+	for (size_t i = 0; i < _queues.size(); ++i) {
+		Queue &queue = *_queues[(worker + i) % _queues.size()];
+		std::lock_guard<std::mutex> queueLock(queue.mutex);
+		if (queue.tasks.empty()) {
+			continue;
+		}
+		if (i == 0) {
+			task = std::move(queue.tasks.back());
+			queue.tasks.pop_back();
+		} else {
+			task = std::move(queue.tasks.front());
+			queue.tasks.pop_front();
+			++_steals;
+		}
+		return true;
+	}
+	return false;
+}
+
+void ThreadPool::workerLoop(size_t worker) {
+	for (;;) {
+		Task task;
+		if (popTask(worker, task)) {
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				--_queued;
+			}
+			task(worker);
+			std::lock_guard<std::mutex> lock(_mutex);
+			if (--_pending == 0) {
+				_idle.notify_all();
+			}
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(_mutex);
+		_wake.wait(lock, [this] { return _stopping || _queued > 0; });
+		if (_stopping && _queued == 0) {
+			return;
+		}
+	}
+}
+
+size_t ThreadPool::getThreadCount() const {
+	return _threads.size();
+}
+
+size_t ThreadPool::getStealCount() const {
+	return _steals.load();
+}
@@ -1,8 +1,92 @@
 #include "CliArguments.hpp"
+#include "CompileCache.hpp"
 #include "LexFileParser.hpp"
 #include "RegexParser.hpp"
+#include "RegexArena.hpp"
+#include "SubstitutionCache.hpp"
+#include "RegexOptimizer.hpp"
+#include "KeywordTable.hpp"
+#include "Nfa.hpp"
+#include "Dfa.hpp"
+#include "CodeGenerator.hpp"
+#include "LazyDfa.hpp"
+#include "Interpreter.hpp"
+#include "GlushkovMatcher.hpp"
+#include "Stats.hpp"
 
+#include <chrono>
+#include <fstream>
 #include <iostream>
+#include <sstream>
+
+static void addNfaStats(Stats *stats, const LexFileParser::Content &content, const Nfa &nfa) {
+	stats->add("NFA states", nfa.getStateCount());
+	stats->add("NFA epsilon edges", nfa.getEpsilonCount());
+	stats->add("NFA character-set edges", nfa.getSetEdgeCount());
+	stats->add("NFA positions", nfa.getPositionCount());
+	stats->add("NFA", nfa.bytesUsed(), "bytes");
+	stats->addLimit("%p", "positions", nfa.getPositionCount(), content.positionsSize);
+	stats->addLimit("%n", "NFA states", nfa.getStateCount(), content.statesSize);
+	stats->addLimit("%a", "NFA transitions", nfa.getEpsilonCount() + nfa.getSetEdgeCount(), content.transitionsSize);
+}
+
+// the front end: the regex trees of the rules, the keyword table and the NFA
+static bool buildNfa(const CliArguments &cliArgs, const LexFileParser::Content &content, Stats *stats, RegexArena &arena,
+	std::vector<RegexParser::NodeId> &roots, KeywordTable &keywords, Nfa &nfa) {
+	Stats::Timer regexTimer(stats, "regex");
+	SubstitutionCache substitutions(content.substitutions, arena);
+	RegexOptimizer optimizer(arena);
+	std::vector<RegexParser::NodeId> parsedRoots;
+	for (const auto &rules : content.rules) {
+		RegexParser regexParser(rules.pattern, substitutions, arena);
+		try {
+			if (!regexParser.parse()) {
+				return false;
+			}
+		} catch (const std::exception &e) {
+			std::cerr << "Error in pattern " << rules.pattern << ": " << e.what() << std::endl;
+			return false;
+		}
+		parsedRoots.push_back(regexParser.getRoot());
+		roots.push_back(cliArgs.isOptimizationEnabled() ? optimizer.optimize(regexParser.getRoot()) : regexParser.getRoot());
+		if (cliArgs.isAstPrintEnabled()) {
+			std::cout << "Pattern: " << rules.pattern << std::endl;
+			regexParser.printNode(roots.back());
+			std::cout << std::endl;
+		}
+	}
+	regexTimer.stop();
+	// --run keeps every rule in its automaton: the lookup is done by the
+	// generated scanner
+	try {
+		Stats::Timer keywordTimer(stats, "keywords");
+		if (cliArgs.isKeywordTableEnabled() && !cliArgs.isRunEnabled() && !keywords.build(content, roots, arena)) {
+			return false;
+		}
+		keywordTimer.stop();
+		Stats::Timer nfaTimer(stats, "NFA");
+		nfa.setLeftOutRules(keywords.getRules());
+		if (!nfa.build(content, roots, arena)) {
+			return false;
+		}
+	} catch (const std::exception &e) {
+		std::cerr << "Error: " << e.what() << std::endl;
+		return false;
+	}
+	if (stats) {
+		stats->add("Regex arena nodes", arena.size());
+		stats->add("Regex arena", arena.bytesUsed(), "bytes");
+		stats->add("Shared regex nodes", arena.getSharedHits());
+		stats->add("Distinct character sets", arena.getSets().size());
+		stats->add("Substitutions parsed", substitutions.getMisses());
+		stats->add("Substitutions reused", substitutions.getHits());
+		stats->add("AST nodes parsed", RegexOptimizer::countNodes(arena, parsedRoots));
+		stats->add("AST nodes after optimization", RegexOptimizer::countNodes(arena, roots));
+		stats->addLimit("%e", "parse tree nodes", RegexOptimizer::countNodes(arena, parsedRoots), content.parseTreeSize);
+		addNfaStats(stats, content, nfa);
+	}
+	return true;
+}
 
 int main(int argc, char **argv) {
 	CliArguments cliArgs(argc, argv);
@@ -10,20 +94,195 @@ int main(int argc, char **argv) {
 		cliArgs.printUsage();
 		return 1;
 	}
+	Stats statsStorage;
+	// the stage timers are idle without --stats
+	Stats *stats = cliArgs.isStatsEnabled() ? &statsStorage : nullptr;
+	if (stats) {
+		Stats::countAllocations();
+	}
 
+	Stats::Timer parseTimer(stats, "lex file");
 	LexFileParser parser(cliArgs.getInputFile());
 	if (!parser.parse()) {
 		return 1;
 	}
 	
-	for (const auto &rules : parser.getContent().rules) {
-		RegexParser regexParser(rules.pattern, parser.getContent().substitutions);
-		if (!regexParser.parse()) {
+	const LexFileParser::Content &content = parser.getContent();
+	parseTimer.stop();
+	// --run and --ast need the regex trees, which the cache does not keep
+	CompileCache cache(cliArgs.getCompileCacheDirectory());
+	bool useCache = cache.isEnabled() && !cliArgs.isRunEnabled() && !cliArgs.isAstPrintEnabled();
+	if (cliArgs.isCompileCacheCleared() && cache.isEnabled() && !cache.clear()) {
+		return 1;
+	}
+	RegexArena arena;
+	std::vector<RegexParser::NodeId> roots;
+	KeywordTable keywords;
+	Nfa nfa;
+	Dfa dfa;
+	size_t statesBeforeMinimization = 0;
+	bool cached = false;
+	if (useCache) {
+		Stats::Timer lookupTimer(stats, "compile cache lookup");
+		cache.setKey(content, cliArgs.getAutomatonOptions());
+		cached = cache.load(nfa, dfa, keywords, statesBeforeMinimization);
+		if (stats) {
+			stats->add("Compile cache", std::string(cached ? "hit" : "miss"));
+		}
+	}
+	if (!cached && !buildNfa(cliArgs, content, stats, arena, roots, keywords, nfa)) {
+		return 1;
+	}
+	if (cached) {
+		dfa.setBudget(cliArgs.getDfaStateBudget(), cliArgs.getDfaMemoryBudget());
+		dfa.reportFallbackRules(content);
+		if (stats) {
+			addNfaStats(stats, content, nfa);
+		}
+	}
+
+	if (cliArgs.isRunEnabled()) {
+		// small rule sets are simulated bit-parallel rather than determinized
+		GlushkovMatcher glushkov;
+		size_t positions = glushkov.countPositions(content, roots, arena);
+		bool useGlushkov = cliArgs.getEngine() != Interpreter::LAZY_DFA && positions <= GlushkovMatcher::MAX_POSITIONS;
+		if (cliArgs.getEngine() == Interpreter::GLUSHKOV && !useGlushkov) {
+			std::cerr << "Error: The rules need more than " << GlushkovMatcher::MAX_POSITIONS
+				<< " positions, too many for the Glushkov engine" << std::endl;
+			return 1;
+		}
+		if (useGlushkov) {
+			Stats::Timer glushkovTimer(stats, "Glushkov automaton");
+			glushkov.build(content, roots, arena);
+		}
+
+		long inputStart = std::ftell(stdin);
+		Stats::Timer runTimer(stats, "run");
+		auto runStart = std::chrono::steady_clock::now();
+		Interpreter interpreter(content, nfa, useGlushkov ? &glushkov : nullptr, cliArgs.getCacheSize(), cliArgs.getThreadCount());
+		if (!interpreter.run(stdin, std::cout, cliArgs.isCountOnly())) {
 			return 1;
 		}
-		regexParser.printTree();
-		std::cout << std::endl;
+		std::chrono::duration<double, std::milli> runTime = std::chrono::steady_clock::now() - runStart;
+		runTimer.stop();
+		if (!stats) {
+			return 0;
+		}
+		if (useGlushkov) {
+			stats->add("Engine", std::string("bit-parallel Glushkov"));
+			stats->add("Glushkov positions", glushkov.getPositionCount());
+			stats->add("Glushkov 64-bit words", glushkov.getWordCount());
+			stats->add("Glushkov tables", glushkov.bytesUsed(), "bytes");
+		} else {
+			stats->add("Engine", std::string(cliArgs.getEngine() == Interpreter::LAZY_DFA ? "lazy DFA (requested)"
+				: "lazy DFA (more than " + std::to_string(GlushkovMatcher::MAX_POSITIONS) + " positions)"));
+			stats->add("Equivalence classes", interpreter.getClassCount());
+			stats->add("Lazy DFA states built", interpreter.getBuiltCount());
+			stats->add("Lazy DFA states cached", interpreter.getCachedCount());
+			stats->add("Lazy DFA flushes", interpreter.getFlushCount());
+			stats->add("Lazy DFA cache", interpreter.getCacheBytes(), "bytes");
+			stats->add("Lazy DFA cache budget", interpreter.getCacheBudget(), "bytes");
+		}
+		stats->add("Tokens", interpreter.getTokenCount());
+		stats->add("Input", interpreter.getByteCount(), "bytes");
+		if (interpreter.getThreadCount() > 1) {
+			stats->add("Threads", interpreter.getThreadCount());
+			stats->add("Chunks", interpreter.getChunkCount());
+			stats->add("Steals", interpreter.getStealCount());
+			stats->add("Rescanned", interpreter.getRescannedBytes(), "bytes");
+			stats->add("Chunk scanning", interpreter.getScanTime(), "ms");
+			// a seekable input is scanned again on one thread to measure the speedup
+			if (inputStart >= 0 && std::fseek(stdin, inputStart, SEEK_SET) == 0) {
+				std::ostringstream discarded;
+				Stats::Timer baselineTimer(stats, "run on 1 thread");
+				auto baselineStart = std::chrono::steady_clock::now();
+				Interpreter baseline(content, nfa, useGlushkov ? &glushkov : nullptr, cliArgs.getCacheSize(), 1);
+				baseline.run(stdin, discarded, true);
+				std::chrono::duration<double, std::milli> baselineTime = std::chrono::steady_clock::now() - baselineStart;
+				baselineTimer.stop();
+				stats->add("Speedup against 1 thread", baselineTime.count() / runTime.count());
+			}
+		}
+		stats->addPeakMemory();
+		stats->write(std::cerr, cliArgs.getStatsFormat());
+		return 0;
+	}
+
+	if (!cached) {
+		Stats::Timer dfaTimer(stats, "DFA");
+		dfa.setBudget(cliArgs.getDfaStateBudget(), cliArgs.getDfaMemoryBudget());
+		if (!dfa.build(nfa, content)) {
+			return 1;
+		}
+		dfaTimer.stop();
+
+		Stats::Timer minimizeTimer(stats, "minimization");
+		statesBeforeMinimization = dfa.minimize();
+		minimizeTimer.stop();
+		if (useCache) {
+			Stats::Timer storeTimer(stats, "compile cache store");
+			cache.store(nfa, dfa, keywords, statesBeforeMinimization);
+		}
+	}
+
+	Stats::Timer codegenTimer(stats, "code generation");
+	CodeGenerator generator(content, dfa, nfa);
+	generator.setSkipLoopsEnabled(cliArgs.areSkipLoopsEnabled());
+	generator.setKeywordTable(keywords);
+	generator.setReentrant(cliArgs.isReentrant(content.reentrant));
+	const BackupAnalysis &backup = generator.getBackupAnalysis();
+	if (cliArgs.isBackupReportEnabled()) {
+		std::ofstream report("lex.backup");
+		if (!report.is_open()) {
+			std::cerr << "Error: Could not open file lex.backup" << std::endl;
+			return 1;
+		}
+		backup.writeReport(report, dfa, content);
+	}
+	if (!cliArgs.isBackingUpAllowed() && !backup.empty()) {
+		const BackupAnalysis::State &first = backup.getStates().front();
+		std::cerr << "Error: The scanner backs up in " << backup.getStates().size() << " DFA states, as on "
+			<< (first.atLineStart ? "^" : "") << BackupAnalysis::quote(first.example) << " back to the rule at line " << content.rules[first.backupRule].line
+			<< " (-b writes them all to lex.backup)" << std::endl;
+		return 1;
+	}
+	bool generated = false;
+	if (cliArgs.getOutputFile() == "-") {
+		generated = generator.generate(std::cout, cliArgs.getTableMode(), cliArgs.getScannerStyle(content.scannerStyle));
+	} else {
+		std::ofstream output(cliArgs.getOutputFile());
+		if (!output.is_open()) {
+			std::cerr << "Error: Could not open file " << cliArgs.getOutputFile() << std::endl;
+			return 1;
+		}
+		generated = generator.generate(output, cliArgs.getTableMode(), cliArgs.getScannerStyle(content.scannerStyle));
+	}
+	if (!generated) {
+		return 1;
+	}
+	codegenTimer.stop();
+
+	if (stats) {
+		stats->add("Keywords looked up", keywords.getKeywordCount());
+		stats->add("Identifier rules with keywords", keywords.getTables().size());
+		stats->add("Equivalence classes", dfa.getClassCount());
+		stats->add("Character sets", dfa.getCharacterSetCount());
+		stats->add("DFA states", statesBeforeMinimization);
+		stats->add("Minimized DFA states", dfa.getStateCount());
+		stats->add("Start conditions", dfa.getStartStateCount());
+		stats->add("DFA states with one DFA per condition", dfa.getSeparateStateCount());
+		stats->add("Rules matched by NFA simulation", dfa.getFallbackCount());
+		stats->add("Full tables", generator.getFullTableBytes(), "bytes");
+		stats->add("Compressed tables", generator.getCompressedTableBytes(), "bytes");
+		stats->add("Direct-coded scanner", generator.getDirectCodeBytes(), "bytes");
+		stats->add("Skip-loop states", generator.getSkipLoopCount());
+		stats->add("Backing-up states", backup.getStates().size());
+		stats->addLimit("%k", "character classes", dfa.getCharacterSetCount(), content.packedCharacterClassesSize);
+		stats->addLimit("%a", "table transitions", generator.getTableTransitionCount(cliArgs.getTableMode()), content.transitionsSize);
+		stats->addLimit("%o", "table entries", generator.getTableEntryCount(cliArgs.getTableMode()), content.outputArraySize);
+		stats->addPeakMemory();
+		stats->write(std::cerr, cliArgs.getStatsFormat());
 	}
 
 	return 0;
-}
\ No newline at end of file
+}
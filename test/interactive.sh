@@ -0,0 +1,40 @@
+#!/bin/sh
+# A default %pointer scanner reading a terminal must print the tokens of each
+# line as soon as the line is typed, long before its input ends. test.l is
+# run in a pseudo-terminal from script(1), fed one line at a time through a
+# FIFO that stays open until the last check.
+#   usage: test/interactive.sh [path/to/ft_lex]
+#   environment:
+#     CC  compiler to use
+
+FT_LEX=${1:-./ft_lex}
+CC=${CC:-cc}
+DIR=$(dirname "$0")
+WORK=$(mktemp -d)
+trap 'exec 3>&-; rm -rf "$WORK"' EXIT
+
+"$FT_LEX" -o "$WORK/lex.yy.c" "$DIR/test.l" || exit 1
+$CC -o "$WORK/scanner" "$WORK/lex.yy.c" || exit 1
+mkfifo "$WORK/in" || exit 1
+script -qfec "$WORK/scanner" "$WORK/out" < "$WORK/in" > /dev/null &
+exec 3> "$WORK/in"
+
+# types $1 and waits up to two seconds for $2 in the output
+line() {
+	printf '%s\n' "$1" >&3
+	for i in 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19 20; do
+		grep -qF "$2" "$WORK/out" 2> /dev/null && return 0
+		sleep 0.1
+	done
+	echo "interactive: no $2 after typing \"$1\"" >&2
+	cat "$WORK/out" >&2
+	return 1
+}
+
+line "if x" "IDENT(x) at line 1" || exit 1
+line "else 42" "NUMBER(42)" || exit 1
+# end of input from the terminal
+printf '\004' >&3
+exec 3>&-
+wait
+echo "interactive: ok"